@@ -0,0 +1,77 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "benchmark.hpp"
+#include "ffmpeg/avframe-queue.hpp"
+
+namespace {
+	bool expect(bool condition, const char* what)
+	{
+		if (!condition) {
+			std::printf("  Unexpected: %s\n", what);
+		}
+		return condition;
+	}
+
+	// The pool must only ever allocate where it says it does, and report when it is full or empty.
+	bool check_avframe_queue()
+	{
+		bool                                  ok = true;
+		streamfx::ffmpeg::avframe_queue       queue(8);
+		streamfx::ffmpeg::avframe_queue       other(8);
+		std::vector<std::shared_ptr<AVFrame>> frames;
+
+		queue.set_resolution(64, 64);
+		queue.set_pixel_format(AV_PIX_FMT_YUV420P);
+		other.set_resolution(64, 64);
+		other.set_pixel_format(AV_PIX_FMT_YUV420P);
+
+		// Preallocation tops the pool up to the requested size, and no further than its capacity.
+		ok &= expect(queue.precache(5) == 5, "precache(5) on an empty pool allocates 5 frames");
+		ok &= expect(queue.precache(5) == 0, "precache(5) on a pool of 5 allocates nothing");
+		ok &= expect(queue.precache(100) == 3, "precache(100) stops at the capacity of 8");
+		ok &= expect(queue.size() == 8, "the pool holds 8 frames");
+
+		// A full pool refuses frames.
+		ok &= expect(!queue.push(other.pop()), "push() into a full pool fails");
+		ok &= expect(queue.get_statistics().rejected == 1, "the refused frame is counted");
+
+		// An empty pool hands out nothing, unless allowed to allocate.
+		for (std::size_t idx = 0; idx < 8; idx++) {
+			frames.push_back(queue.try_pop());
+			ok &= expect(frames.back() != nullptr, "try_pop() returns every pooled frame");
+		}
+		ok &= expect(queue.try_pop() == nullptr, "try_pop() on an empty pool returns nothing");
+		ok &= expect(queue.get_statistics().misses == 0, "try_pop() never allocates");
+		ok &= expect(queue.pop() != nullptr, "pop() on an empty pool allocates");
+		ok &= expect(queue.get_statistics().misses == 1, "the allocation is counted");
+		ok &= expect(queue.get_statistics().hits == 8, "every reused frame is counted");
+
+		// Frames of an outdated resolution are never handed out.
+		ok &= expect(queue.push(frames.back()), "push() into an empty pool succeeds");
+		queue.set_resolution(32, 32);
+		ok &= expect(queue.try_pop() == nullptr, "try_pop() skips frames of an outdated resolution");
+		ok &= expect(queue.get_statistics().reallocations == 1, "the outdated frame is counted");
+		ok &= expect(queue.empty(), "the outdated frame was released");
+
+		return ok;
+	}
+
+	streamfx::benchmark::registration _avframe_queue("ffmpeg.avframe_queue", true, check_avframe_queue);
+} // namespace
@@ -0,0 +1,71 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace streamfx::benchmark {
+	/** Something the micro benchmark can run. A check fails the run if it returns false, a benchmark only reports. */
+	struct entry {
+		std::string           name;
+		bool                  is_check;
+		std::function<bool()> function;
+	};
+
+	std::vector<entry>& entries();
+
+	/** Registers an entry when constructed, meant to be used for file scope statics. */
+	struct registration {
+		registration(const char* name, bool is_check, std::function<bool()> function)
+		{
+			entries().push_back({name, is_check, std::move(function)});
+		}
+	};
+
+	/** Run a callable repeatedly for at least the given time, after a single warm-up call.
+	 *
+	 * @return Average nanoseconds per call.
+	 */
+	template<typename T>
+	double measure(T&& function, std::chrono::milliseconds duration = std::chrono::milliseconds(250))
+	{
+		function();
+
+		std::size_t calls = 0;
+		auto        start = std::chrono::steady_clock::now();
+		auto        now   = start;
+		do {
+			function();
+			calls++;
+			now = std::chrono::steady_clock::now();
+		} while ((now - start) < duration);
+		return std::chrono::duration<double, std::nano>(now - start).count() / static_cast<double>(calls);
+	}
+
+	/** Bytes per nanosecond to GiB/s. */
+	inline double gibps(double bytes, double ns)
+	{
+		return (ns > 0) ? (bytes / ns * 1e9 / 1073741824.) : 0.;
+	}
+} // namespace streamfx::benchmark
@@ -0,0 +1,812 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+// Standalone encoder benchmark: loads StreamFX into a headless libOBS, feeds raw frames to an encoder through a
+// video output of its own, exactly like OBS would, and reports throughput, latency and where the time went. Needs
+// no GPU, so it can run in CI. Stage timings are only available if StreamFX was built with ENABLE_PROFILING.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "obs/obs-encoder-statistics.hpp"
+
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4201)
+#endif
+#include <obs-module.h>
+#include <obs.h>
+#include <util/platform.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Frames libOBS can hold between us and the encoder, which is also its upper limit.
+#define ST_CACHE_SIZE 16
+
+// Frames of input kept in memory and looped over, so that reading input never competes with the encoder.
+#define ST_INPUT_FRAMES 60
+
+#define ST_OUTPUT_ID "streamfx-benchmark-output"
+
+// Multi-pass settings of AOM AV1, see aom_enc_pass.
+#define ST_KEY_ENCODER_PASS "Encoder.Pass"
+#define ST_KEY_ENCODER_PASS_STATISTICS "Encoder.Pass.Statistics"
+#define ST_PASS_FIRST "1"
+#define ST_PASS_SECOND "2"
+
+// Exit code for encoders missing from this build, which CTest reports as skipped instead of failed.
+#define ST_EXIT_SKIPPED 77
+
+namespace {
+	struct options {
+		std::string              module = ST_BENCHMARK_MODULE;
+		std::string              data   = ST_BENCHMARK_DATA;
+		std::string              input;
+		video_format             format   = VIDEO_FORMAT_I420;
+		uint32_t                 width    = 1920;
+		uint32_t                 height   = 1080;
+		uint32_t                 fps_num  = 60;
+		uint32_t                 fps_den  = 1;
+		uint32_t                 frames   = 600;
+		bool                     realtime = false;
+		bool                     verbose  = false;
+		bool                     two_pass = false;
+
+		// Settings to repeat every run with, once for each combination of their values.
+		std::vector<std::pair<std::string, std::vector<std::string>>> sweeps;
+
+		// Settings applied to the encoder while it is running, before the given frame.
+		std::vector<std::pair<uint32_t, std::string>> updates;
+
+		// What every run must have produced, checked once it completed. Negative if not checked.
+		int64_t expect_keyframes = -1;
+
+		// Bitrate in kbit/s from the given frame on, up to the next expectation or the last frame.
+		std::vector<std::pair<uint32_t, double>> expect_bitrates;
+	};
+
+	struct run {
+		std::string                                      label;
+		std::string                                      encoder;
+		std::string                                      settings;  // JSON
+		std::vector<std::pair<std::string, std::string>> overrides; // Settings replaced by --sweep and --two-pass.
+
+		// Only produces statistics for the pass after it, but no video.
+		bool first_pass = false;
+	};
+
+	struct result {
+		std::string                 label;
+		bool                        completed = false;
+		bool                        missing   = false; // The encoder isn't available in this build.
+		uint32_t                    frames    = 0;
+		uint32_t                    dropped   = 0;
+		uint64_t                    packets   = 0;
+		uint64_t                    keyframes = 0;
+		uint64_t                    bytes     = 0;
+		double                      seconds   = 0;
+		std::vector<double>         latencies; // Milliseconds from submitting a frame to receiving its packet.
+		std::vector<uint64_t>       sizes;     // Bytes of the packets of each frame.
+		bool                        have_statistics = false;
+		streamfx_encoder_statistics statistics      = {};
+	};
+
+	// Receives the packets of the encoder under test, as the only output attached to it.
+	struct collector {
+		obs_output_t*                                      output;
+		uint32_t                                           fps_den;
+		std::vector<std::chrono::steady_clock::time_point> submitted; // Per frame, set before handing it to OBS.
+		std::mutex                                         lock;
+		uint64_t                                           packets;
+		uint64_t                                           keyframes;
+		uint64_t                                           bytes;
+		std::vector<double>                                latencies;
+		std::vector<uint64_t>                              sizes;
+	};
+	collector* _collector = nullptr;
+
+	struct plane {
+		uint32_t width; // In bytes.
+		uint32_t height;
+	};
+
+	std::vector<plane> planes_for(video_format format, uint32_t width, uint32_t height)
+	{
+		uint32_t cw = (width + 1) / 2;
+		uint32_t ch = (height + 1) / 2;
+		switch (format) {
+		case VIDEO_FORMAT_I420:
+			return {{width, height}, {cw, ch}, {cw, ch}};
+		case VIDEO_FORMAT_NV12:
+			return {{width, height}, {cw * 2, ch}};
+		case VIDEO_FORMAT_I444:
+			return {{width, height}, {width, height}, {width, height}};
+		default:
+			return {};
+		}
+	}
+
+	/** Frames to feed, either read from a raw file or a synthetic pattern that encoders can't trivially skip. */
+	struct input {
+		std::vector<plane>                             planes;
+		std::vector<std::vector<std::vector<uint8_t>>> frames; // Frame, Plane, Data
+
+		bool load(const options& opts)
+		{
+			planes = planes_for(opts.format, opts.width, opts.height);
+			if (opts.input.empty()) {
+				generate();
+				return true;
+			}
+
+			std::ifstream file(opts.input, std::ios::binary);
+			if (!file) {
+				std::fprintf(stderr, "Failed to open input '%s'.\n", opts.input.c_str());
+				return false;
+			}
+			while (frames.size() < ST_INPUT_FRAMES) {
+				std::vector<std::vector<uint8_t>> frame;
+				for (auto& p : planes) {
+					std::vector<uint8_t> data(static_cast<size_t>(p.width) * p.height);
+					if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+						break;
+					}
+					frame.push_back(std::move(data));
+				}
+				if (frame.size() != planes.size()) {
+					break;
+				}
+				frames.push_back(std::move(frame));
+			}
+			if (frames.empty()) {
+				std::fprintf(stderr, "Input '%s' holds less than a single frame.\n", opts.input.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		void generate()
+		{
+			uint32_t state = 0x9E3779B9;
+			auto     noise = [&state]() {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return state;
+			};
+
+			for (uint32_t idx = 0; idx < ST_INPUT_FRAMES; idx++) {
+				std::vector<std::vector<uint8_t>> frame;
+				for (size_t pidx = 0; pidx < planes.size(); pidx++) {
+					auto&                p = planes[pidx];
+					std::vector<uint8_t> data(static_cast<size_t>(p.width) * p.height);
+					for (uint32_t y = 0; y < p.height; y++) {
+						uint8_t* row = data.data() + static_cast<size_t>(y) * p.width;
+						for (uint32_t x = 0; x < p.width; x++) {
+							if (pidx == 0) { // Moving diagonal pattern with some grain on top.
+								row[x] = static_cast<uint8_t>(((x + idx * 4) ^ (y + idx * 2)) + (noise() & 0x0F));
+							} else { // Slowly shifting gradients.
+								row[x] = static_cast<uint8_t>((pidx == 1 ? x : y) + idx);
+							}
+						}
+					}
+					frame.push_back(std::move(data));
+				}
+				frames.push_back(std::move(frame));
+			}
+		}
+
+		void copy(uint32_t index, struct video_frame& frame)
+		{
+			auto& source = frames[index % frames.size()];
+			for (size_t pidx = 0; pidx < planes.size(); pidx++) {
+				for (uint32_t y = 0; y < planes[pidx].height; y++) {
+					std::memcpy(frame.data[pidx] + static_cast<size_t>(y) * frame.linesize[pidx],
+								source[pidx].data() + static_cast<size_t>(y) * planes[pidx].width, planes[pidx].width);
+				}
+			}
+		}
+	};
+
+	uint64_t peak_memory()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS pmc = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+			return pmc.PeakWorkingSetSize;
+		}
+		return 0;
+#else
+		struct rusage usage = {};
+		if (getrusage(RUSAGE_SELF, &usage) != 0) {
+			return 0;
+		}
+#ifdef __APPLE__
+		return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+		return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty()) {
+			return 0;
+		}
+		size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+		return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+	}
+
+	void log_handler(int level, const char* message, va_list args, void* param)
+	{
+		auto* opts = reinterpret_cast<options*>(param);
+		if (opts->verbose || (level <= LOG_ERROR)) {
+			std::vfprintf(stderr, message, args);
+			std::fputc('\n', stderr);
+		}
+	}
+
+	// Output
+	const char* output_get_name(void*)
+	{
+		return "StreamFX Benchmark";
+	}
+
+	void* output_create(obs_data_t*, obs_output_t* output)
+	{
+		_collector->output = output;
+		return _collector;
+	}
+
+	void output_destroy(void*) {}
+
+	bool output_start(void* data)
+	{
+		auto* c = reinterpret_cast<collector*>(data);
+		if (!obs_output_can_begin_data_capture(c->output, 0) || !obs_output_initialize_encoders(c->output, 0)) {
+			return false;
+		}
+		return obs_output_begin_data_capture(c->output, 0);
+	}
+
+	void output_stop(void* data, uint64_t)
+	{
+		obs_output_end_data_capture(reinterpret_cast<collector*>(data)->output);
+	}
+
+	void output_encoded_packet(void* data, struct encoder_packet* packet)
+	{
+		auto* c   = reinterpret_cast<collector*>(data);
+		auto  now = std::chrono::steady_clock::now();
+		if (!packet || (packet->type != OBS_ENCODER_VIDEO)) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(c->lock);
+		c->packets++;
+		c->keyframes += packet->keyframe ? 1 : 0;
+		c->bytes += packet->size;
+		if (auto index = static_cast<uint64_t>(packet->pts) / c->fps_den; index < c->submitted.size()) {
+			c->latencies.push_back(std::chrono::duration<double, std::milli>(now - c->submitted[index]).count());
+			c->sizes[index] += packet->size;
+		}
+	}
+
+	bool execute(const options& opts, const run& r, input& in, streamfx_encoder_get_statistics_t get_statistics,
+				 result& res)
+	{
+		res.label = r.label;
+
+		obs_data_t* settings = r.settings.empty() ? obs_data_create() : obs_data_create_from_json(r.settings.c_str());
+		if (!settings) {
+			std::fprintf(stderr, "[%s] Settings are not valid JSON.\n", r.label.c_str());
+			return false;
+		}
+		for (auto& [key, text] : r.overrides) {
+			char*     end   = nullptr;
+			long long value = std::strtoll(text.c_str(), &end, 10);
+			if (end && (*end == '\0')) {
+				obs_data_set_int(settings, key.c_str(), value);
+			} else if (double dvalue = std::strtod(text.c_str(), &end); end && (*end == '\0')) {
+				obs_data_set_double(settings, key.c_str(), dvalue);
+			} else if ((text == "true") || (text == "false")) {
+				obs_data_set_bool(settings, key.c_str(), text == "true");
+			} else {
+				obs_data_set_string(settings, key.c_str(), text.c_str());
+			}
+		}
+
+		struct video_output_info voi = {};
+		voi.name                     = "StreamFX Benchmark";
+		voi.format                   = opts.format;
+		voi.fps_num                  = opts.fps_num;
+		voi.fps_den                  = opts.fps_den;
+		voi.width                    = opts.width;
+		voi.height                   = opts.height;
+		voi.cache_size               = ST_CACHE_SIZE;
+		voi.colorspace               = VIDEO_CS_709;
+		voi.range                    = VIDEO_RANGE_PARTIAL;
+
+		video_t* video = nullptr;
+		if (video_output_open(&video, &voi) != VIDEO_OUTPUT_SUCCESS) {
+			std::fprintf(stderr, "[%s] Failed to open video output.\n", r.label.c_str());
+			obs_data_release(settings);
+			return false;
+		}
+
+		collector c = {};
+		c.fps_den   = opts.fps_den;
+		c.submitted.resize(opts.frames);
+		c.sizes.resize(opts.frames);
+		_collector = &c;
+
+		obs_encoder_t* encoder = obs_video_encoder_create(r.encoder.c_str(), r.label.c_str(), settings, nullptr);
+		obs_output_t*  output  = obs_output_create(ST_OUTPUT_ID, r.label.c_str(), nullptr, nullptr);
+		obs_data_release(settings);
+
+		bool started = false;
+		if (!encoder) {
+			std::fprintf(stderr, "[%s] Encoder '%s' does not exist.\n", r.label.c_str(), r.encoder.c_str());
+			res.missing = true;
+		} else if (!output) {
+			std::fprintf(stderr, "[%s] Failed to create output.\n", r.label.c_str());
+		} else {
+			obs_encoder_set_video(encoder, video);
+			obs_output_set_video_encoder(output, encoder);
+			started = obs_output_start(output);
+			if (!started) {
+				std::fprintf(stderr, "[%s] Failed to start encoder: %s\n", r.label.c_str(),
+							 obs_output_get_last_error(output) ? obs_output_get_last_error(output) : "Unknown error");
+			}
+		}
+
+		if (started) {
+			auto frame_time = std::chrono::nanoseconds(video_output_get_frame_time(video));
+			auto start      = std::chrono::steady_clock::now();
+			for (uint32_t idx = 0; idx < opts.frames; idx++) {
+				if (opts.realtime) {
+					std::this_thread::sleep_until(start + frame_time * idx);
+				} else {
+					// Stay within what libOBS can queue, it would duplicate frames instead of waiting otherwise.
+					while ((idx - video_output_get_total_frames(video)) >= ST_CACHE_SIZE) {
+						std::this_thread::sleep_for(std::chrono::microseconds(50));
+					}
+				}
+
+				for (auto& update : opts.updates) {
+					if (update.first == idx) {
+						obs_data_t* data = obs_data_create_from_json(update.second.c_str());
+						obs_encoder_update(encoder, data);
+						obs_data_release(data);
+					}
+				}
+
+				struct video_frame frame = {};
+				c.submitted[idx]         = std::chrono::steady_clock::now();
+				if (video_output_lock_frame(video, &frame, 1, static_cast<uint64_t>(frame_time.count()) * idx)) {
+					in.copy(idx, frame);
+					video_output_unlock_frame(video);
+				} else {
+					res.dropped++; // libOBS hands the previous frame to the encoder again instead.
+				}
+			}
+			while (video_output_get_total_frames(video) < opts.frames) {
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+			res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			res.frames  = opts.frames;
+
+			// Encoders are gone once the output stops, so ask before that.
+			res.completed = obs_output_active(output);
+			if (get_statistics) {
+				res.have_statistics = get_statistics(encoder, &res.statistics);
+			}
+			if (!res.completed) {
+				std::fprintf(stderr, "[%s] Encoder stopped early: %s\n", r.label.c_str(),
+							 obs_output_get_last_error(output) ? obs_output_get_last_error(output) : "Unknown error");
+			}
+
+			obs_output_stop(output);
+			while (obs_output_active(output)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		obs_output_release(output);
+		obs_encoder_release(encoder);
+		video_output_close(video);
+		_collector = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(c.lock);
+			res.packets   = c.packets;
+			res.keyframes = c.keyframes;
+			res.bytes     = c.bytes;
+			res.latencies = std::move(c.latencies);
+			res.sizes     = std::move(c.sizes);
+		}
+		std::sort(res.latencies.begin(), res.latencies.end());
+		return res.completed;
+	}
+
+	/** Compares a completed run against what it was expected to produce, and explains every mismatch. */
+	bool verify(const options& opts, const result& res)
+	{
+		bool ok = true;
+		if ((opts.expect_keyframes >= 0) && (res.keyframes != static_cast<uint64_t>(opts.expect_keyframes))) {
+			std::printf("  Expected:  %" PRId64 " key frames, got %" PRIu64 "\n", opts.expect_keyframes, res.keyframes);
+			ok = false;
+		}
+
+		auto bitrates = opts.expect_bitrates;
+		std::sort(bitrates.begin(), bitrates.end());
+		for (size_t idx = 0; idx < bitrates.size(); idx++) {
+			uint32_t first = std::min(bitrates[idx].first, res.frames);
+			uint32_t last  = (idx + 1 < bitrates.size()) ? std::min(bitrates[idx + 1].first, res.frames) : res.frames;
+			if (first >= last) {
+				continue;
+			}
+
+			// Rate control needs time to settle, so only gross misses count: within half to twice the target.
+			uint64_t bytes = 0;
+			for (uint32_t frame = first; frame < last; frame++) {
+				bytes += res.sizes[frame];
+			}
+			double length  = static_cast<double>(last - first) * opts.fps_den / opts.fps_num;
+			double bitrate = bytes * 8. / length / 1000.;
+			bool   inside  = (bitrate >= bitrates[idx].second * 0.5) && (bitrate <= bitrates[idx].second * 2.);
+			std::printf("  Expected:  %.0f kbit/s for frames %" PRIu32 " to %" PRIu32 ", got %.0f kbit/s%s\n",
+						bitrates[idx].second, first, last - 1, bitrate, inside ? "" : " (MISMATCH)");
+			ok &= inside;
+		}
+		return ok;
+	}
+
+	void print_stage(const char* name, const streamfx_encoder_stage& stage)
+	{
+		if (stage.count == 0) {
+			return;
+		}
+		std::printf("  %-10s %10" PRIu64 " | %9.3f | %9.3f | %9.3f | %9.3f | %9.3f\n", name, stage.count,
+					stage.total / 1e6 / static_cast<double>(stage.count), stage.p50 / 1e6, stage.p90 / 1e6,
+					stage.p99 / 1e6, stage.p999 / 1e6);
+	}
+
+	void print(const options& opts, const result& res)
+	{
+		double fps     = res.seconds > 0 ? res.frames / res.seconds : 0;
+		double length  = static_cast<double>(res.frames) * opts.fps_den / opts.fps_num;
+		double bitrate = length > 0 ? res.bytes * 8. / length / 1000. : 0;
+
+		std::printf("%s\n", res.label.c_str());
+		if (!res.completed) {
+			std::printf("  Failed, see above.\n");
+			return;
+		}
+		std::printf("  Frames:    %" PRIu32 " submitted, %" PRIu32 " dropped, %" PRIu64 " packets (%" PRIu64
+					" key frames), %.0f kbit/s\n",
+					res.frames, res.dropped, res.packets, res.keyframes, bitrate);
+		std::printf("  Speed:     %.2f fps (%.3f s)\n", fps, res.seconds);
+		std::printf("  Latency:   p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms\n",
+					percentile(res.latencies, 0.5), percentile(res.latencies, 0.9), percentile(res.latencies, 0.99),
+					percentile(res.latencies, 0.999));
+		if (res.have_statistics) {
+			auto& s = res.statistics;
+			if (s.copy.count || s.convert.count || s.encode.count || s.packet.count) {
+				std::printf("  Stage      %10s | %9s | %9s | %9s | %9s | %9s\n", "Count", "Avg. ms", "p50 ms", "p90 ms",
+							"p99 ms", "p99.9 ms");
+				print_stage("Copy", s.copy);
+				print_stage("Convert", s.convert);
+				print_stage("Encode", s.encode);
+				print_stage("Packet", s.packet);
+			}
+			std::printf("  Pool:      %.1f MiB at peak\n", s.pool_peak_bytes / 1048576.);
+			if (s.graphics_waits) {
+				std::printf("  Graphics:  entered %" PRIu64 " times, waited %.3f ms\n", s.graphics_waits,
+							s.graphics_wait_ns / 1e6);
+			}
+		}
+	}
+
+	void usage(const char* self)
+	{
+		std::printf(
+			"Usage: %s [options] --run <encoder>[=<settings>] [--run ...]\n"
+			"\n"
+			"  --run <encoder>[=<settings>]  Encoder id to benchmark, with optional settings as JSON.\n"
+			"  --sweep <key>=<v1>,<v2>,...   Repeat every run once for each value of a setting, for example\n"
+			"                                'Encoder.CPUUsage=4,6,8' to compare AOM AV1 presets. Can be given\n"
+			"                                multiple times to sweep every combination.\n"
+			"  --input <file>                Raw frames with tightly packed planes, looped. A synthetic pattern\n"
+			"                                is used if omitted.\n"
+			"  --format <i420|nv12|i444>     Format of the frames. Default: i420\n"
+			"  --size <width>x<height>       Size of the frames. Default: 1920x1080\n"
+			"  --fps <num>[/<den>]           Frame rate. Default: 60\n"
+			"  --frames <count>              Frames per run. Default: 600\n"
+			"  --update <frame>=<settings>   Update the running encoder with settings as JSON before the given\n"
+			"                                frame, for example '300={\"KeyFrame.Request\":1}' to request a\n"
+			"                                key frame. Can be given multiple times.\n"
+			"  --expect-keyframes <count>    Fail unless every run produced exactly this many key frames.\n"
+			"  --expect-bitrate <frame>=<kbit/s>\n"
+			"                                Fail unless the bitrate from the given frame on, up to the next\n"
+			"                                expectation, is within half to twice the given one. Combine with\n"
+			"                                --update to test changing rate control while encoding. Can be\n"
+			"                                given multiple times.\n"
+			"  --two-pass                    Run every run twice, first writing statistics and then encoding with\n"
+			"                                them, for encoders that support it such as AOM AV1 in good quality\n"
+			"                                usage. The first pass produces no video, only the second is checked\n"
+			"                                against expectations.\n"
+			"  --realtime                    Submit frames at the frame rate instead of as fast as the encoder\n"
+			"                                takes them, dropping frames like OBS does if it falls behind.\n"
+			"  --module <file>               StreamFX module to load. Default: %s\n"
+			"  --data <path>                 StreamFX data directory. Default: %s\n"
+			"  --verbose                     Show everything libOBS and StreamFX log.\n"
+			"\n"
+			"Exits with 2 if a run failed, 3 if a run did not meet expectations, and 77 if an encoder is not\n"
+			"available in this build but nothing else went wrong.\n",
+			self, ST_BENCHMARK_MODULE, ST_BENCHMARK_DATA);
+	}
+
+	bool parse(int argc, const char* argv[], options& opts, std::vector<run>& runs)
+	{
+		for (int idx = 1; idx < argc; idx++) {
+			std::string arg   = argv[idx];
+			const char* value = (idx + 1 < argc) ? argv[idx + 1] : nullptr;
+			auto        next  = [&]() {
+				if (!value) {
+					throw std::invalid_argument(arg + " requires a value.");
+				}
+				idx++;
+				return std::string(value);
+			};
+
+			if (arg == "--run") {
+				run r;
+				r.label = next();
+				auto eq = r.label.find('=');
+				r.encoder  = r.label.substr(0, eq);
+				r.settings = (eq == std::string::npos) ? "" : r.label.substr(eq + 1);
+				runs.push_back(r);
+			} else if (arg == "--sweep") {
+				std::string sweep = next();
+				auto        eq    = sweep.find('=');
+				if (eq == std::string::npos) {
+					throw std::invalid_argument("--sweep requires <key>=<values>.");
+				}
+				auto& [key, values] = opts.sweeps.emplace_back(sweep.substr(0, eq), std::vector<std::string>());
+				for (size_t pos = eq + 1, end; pos <= sweep.size(); pos = end + 1) {
+					end = std::min(sweep.find(',', pos), sweep.size());
+					values.push_back(sweep.substr(pos, end - pos));
+				}
+			} else if (arg == "--update") {
+				std::string update = next();
+				auto        eq     = update.find('=');
+				if (eq == std::string::npos) {
+					throw std::invalid_argument("--update requires <frame>=<settings>.");
+				}
+				opts.updates.emplace_back(static_cast<uint32_t>(std::stoul(update.substr(0, eq))),
+										  update.substr(eq + 1));
+			} else if (arg == "--expect-keyframes") {
+				opts.expect_keyframes = std::stoll(next());
+			} else if (arg == "--expect-bitrate") {
+				std::string expect = next();
+				auto        eq     = expect.find('=');
+				if (eq == std::string::npos) {
+					throw std::invalid_argument("--expect-bitrate requires <frame>=<kbit/s>.");
+				}
+				opts.expect_bitrates.emplace_back(static_cast<uint32_t>(std::stoul(expect.substr(0, eq))),
+												  std::stod(expect.substr(eq + 1)));
+			} else if (arg == "--input") {
+				opts.input = next();
+			} else if (arg == "--format") {
+				std::string format = next();
+				if (format == "i420") {
+					opts.format = VIDEO_FORMAT_I420;
+				} else if (format == "nv12") {
+					opts.format = VIDEO_FORMAT_NV12;
+				} else if (format == "i444") {
+					opts.format = VIDEO_FORMAT_I444;
+				} else {
+					throw std::invalid_argument("Unsupported format '" + format + "'.");
+				}
+			} else if (arg == "--size") {
+				if (std::sscanf(next().c_str(), "%" SCNu32 "x%" SCNu32, &opts.width, &opts.height) != 2) {
+					throw std::invalid_argument("--size requires <width>x<height>.");
+				}
+			} else if (arg == "--fps") {
+				opts.fps_den = 1;
+				if (std::sscanf(next().c_str(), "%" SCNu32 "/%" SCNu32, &opts.fps_num, &opts.fps_den) < 1) {
+					throw std::invalid_argument("--fps requires <num>[/<den>].");
+				}
+			} else if (arg == "--frames") {
+				opts.frames = static_cast<uint32_t>(std::stoul(next()));
+			} else if (arg == "--two-pass") {
+				opts.two_pass = true;
+			} else if (arg == "--realtime") {
+				opts.realtime = true;
+			} else if (arg == "--module") {
+				opts.module = next();
+			} else if (arg == "--data") {
+				opts.data = next();
+			} else if (arg == "--verbose") {
+				opts.verbose = true;
+			} else {
+				throw std::invalid_argument("Unknown option '" + arg + "'.");
+			}
+		}
+
+		if ((opts.width == 0) || (opts.height == 0) || (opts.fps_num == 0) || (opts.fps_den == 0)
+			|| (opts.frames == 0)) {
+			throw std::invalid_argument("Size, frame rate and frame count must not be zero.");
+		}
+
+		// Every run once for each value that is swept, and for each combination if more than one setting is.
+		for (auto& [key, values] : opts.sweeps) {
+			std::vector<run> swept;
+			for (auto& r : runs) {
+				for (auto& v : values) {
+					run s = r;
+					s.overrides.emplace_back(key, v);
+					s.label = r.label + " [" + key + "=" + v + "]";
+					swept.push_back(s);
+				}
+			}
+			runs = std::move(swept);
+		}
+
+		// Every run twice, first gathering statistics and then encoding with them, each with a file of its own.
+		if (opts.two_pass) {
+			auto             path = std::filesystem::temp_directory_path() / "streamfx-benchmark";
+			std::vector<run> passes;
+			for (size_t idx = 0; idx < runs.size(); idx++) {
+				std::string stats = (path / ("pass-" + std::to_string(idx) + ".stats")).u8string();
+
+				run first        = runs[idx];
+				first.first_pass = true;
+				first.overrides.emplace_back(ST_KEY_ENCODER_PASS, ST_PASS_FIRST);
+				first.overrides.emplace_back(ST_KEY_ENCODER_PASS_STATISTICS, stats);
+				first.label += " [pass 1]";
+				passes.push_back(first);
+
+				run second = runs[idx];
+				second.overrides.emplace_back(ST_KEY_ENCODER_PASS, ST_PASS_SECOND);
+				second.overrides.emplace_back(ST_KEY_ENCODER_PASS_STATISTICS, stats);
+				second.label += " [pass 2]";
+				passes.push_back(second);
+			}
+			runs = std::move(passes);
+		}
+		return !runs.empty();
+	}
+} // namespace
+
+int main(int argc, const char* argv[])
+try {
+	options          opts;
+	std::vector<run> runs;
+	try {
+		if (!parse(argc, argv, opts, runs)) {
+			usage(argv[0]);
+			return 1;
+		}
+	} catch (const std::exception& ex) {
+		std::fprintf(stderr, "%s\n\n", ex.what());
+		usage(argv[0]);
+		return 1;
+	}
+
+	input in;
+	if (!in.load(opts)) {
+		return 1;
+	}
+
+	base_set_log_handler(log_handler, &opts);
+
+	// libOBS without a graphics subsystem, StreamFX then only loads its encoders.
+	auto config = std::filesystem::temp_directory_path() / "streamfx-benchmark";
+	std::filesystem::create_directories(config);
+	if (!obs_startup("en-US", config.string().c_str(), nullptr)) {
+		std::fprintf(stderr, "Failed to start libOBS.\n");
+		return 1;
+	}
+
+	int                               code           = 0;
+	streamfx_encoder_get_statistics_t get_statistics = nullptr;
+	obs_module_t*                     module         = nullptr;
+	if (obs_open_module(&module, opts.module.c_str(), opts.data.c_str()) != MODULE_SUCCESS) {
+		std::fprintf(stderr, "Failed to open module '%s'.\n", opts.module.c_str());
+		code = 1;
+	} else if (!obs_init_module(module)) {
+		std::fprintf(stderr, "Failed to initialize module '%s'.\n", opts.module.c_str());
+		code = 1;
+	} else {
+		get_statistics = reinterpret_cast<streamfx_encoder_get_statistics_t>(
+			os_dlsym(obs_get_module_lib(module), ST_ENCODER_GET_STATISTICS));
+
+		struct obs_output_info info = {};
+		info.id                     = ST_OUTPUT_ID;
+		info.flags                  = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED;
+		info.get_name               = output_get_name;
+		info.create                 = output_create;
+		info.destroy                = output_destroy;
+		info.start                  = output_start;
+		info.stop                   = output_stop;
+		info.encoded_packet         = output_encoded_packet;
+		obs_register_output(&info);
+
+		std::vector<result> results;
+		bool                failed = false, mismatched = false, missing = false;
+		for (auto& r : runs) {
+			result res;
+			bool completed = execute(opts, r, in, get_statistics, res);
+			print(opts, res);
+			if (completed && !r.first_pass) {
+				mismatched |= !verify(opts, res);
+			} else {
+				missing |= res.missing;
+				failed |= !res.missing;
+			}
+			results.push_back(std::move(res));
+		}
+		code = failed ? 2 : (mismatched ? 3 : (missing ? ST_EXIT_SKIPPED : 0));
+
+		// One line per run, to compare presets at a glance.
+		std::printf("\n%-48s | %9s | %9s | %9s | %9s\n", "Run", "fps", "p50 ms", "p99 ms", "p99.9 ms");
+		for (auto& res : results) {
+			if (!res.completed) {
+				std::printf("%-48s | %9s\n", res.label.c_str(), "failed");
+				continue;
+			}
+			std::printf("%-48s | %9.2f | %9.3f | %9.3f | %9.3f\n", res.label.c_str(),
+						res.seconds > 0 ? res.frames / res.seconds : 0, percentile(res.latencies, 0.5),
+						percentile(res.latencies, 0.99), percentile(res.latencies, 0.999));
+		}
+		std::printf("Peak memory: %.1f MiB\n", peak_memory() / 1048576.);
+	}
+
+	obs_shutdown();
+	return code;
+} catch (const std::exception& ex) {
+	std::fprintf(stderr, "Unexpected exception: %s\n", ex.what());
+	return 1;
+}
@@ -0,0 +1,184 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <random>
+#include "benchmark.hpp"
+#include "encoders/codecs/h264.hpp"
+
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4201)
+#endif
+#include <obs-avc.h>
+#include <util/bmem.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
+using namespace streamfx::encoder::codec;
+
+namespace {
+	// 1080p High profile parameter sets, as x264 and NVENC write them. The SPS contains emulation prevention bytes.
+	const std::vector<uint8_t> sps = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78, 0x02, 0x27, 0xE5, 0xC0,
+									  0x44, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03, 0x00, 0xF0, 0x3C,
+									  0x60, 0xC6, 0x58};
+	const std::vector<uint8_t> pps = {0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0};
+
+	// Buffering period and picture timing, which NVENC sends with every IDR picture.
+	const std::vector<uint8_t> sei_timing = {0x06, 0x00, 0x07, 0x80, 0xAF, 0xC8, 0x00, 0x57,
+											 0xE4, 0x40, 0x01, 0x04, 0x00, 0x00, 0x03, 0x00,
+											 0x02, 0x10, 0x80};
+
+	// Access unit delimiter of an I picture.
+	const std::vector<uint8_t> aud = {0x09, 0x10};
+
+	/** User data unregistered SEI, with x264's UUID and a version string like it writes into the first frame. */
+	std::vector<uint8_t> sei_x264()
+	{
+		const uint8_t uuid[16] = {0xDC, 0x45, 0xE9, 0xBD, 0xE6, 0xD9, 0x48, 0xB7,
+								  0x96, 0x2C, 0xD8, 0x20, 0xD9, 0x23, 0xEE, 0xEF};
+		const char*   text     = "x264 - core 164 - H.264/MPEG-4 AVC codec - Copyleft 2003-2022 - "
+								 "options: cabac=1 ref=3 deblock=1:0:0 analyse=0x3:0x113";
+
+		std::vector<uint8_t> sei = {0x06, 0x05, static_cast<uint8_t>(sizeof(uuid) + std::strlen(text) + 1)};
+		sei.insert(sei.end(), uuid, uuid + sizeof(uuid));
+		sei.insert(sei.end(), text, text + std::strlen(text) + 1);
+		sei.push_back(0x80); // rbsp_trailing_bits
+		return sei;
+	}
+
+	/** An Annex-B access unit put together unit by unit. */
+	struct access_unit {
+		std::vector<uint8_t> data;
+		std::mt19937         rng{1};
+
+		access_unit& add(const std::vector<uint8_t>& unit, bool long_start_code)
+		{
+			if (long_start_code) {
+				data.push_back(0x00);
+			}
+			data.insert(data.end(), {0x00, 0x00, 0x01});
+			data.insert(data.end(), unit.begin(), unit.end());
+			return *this;
+		}
+
+		// Slice data is noise without zero bytes, so it never contains anything that looks like a start code.
+		access_unit& slice(uint8_t header, std::size_t size, bool long_start_code)
+		{
+			std::vector<uint8_t> unit = {header};
+			for (std::size_t idx = 1; idx < size; idx++) {
+				unit.push_back(static_cast<uint8_t>(std::max<uint32_t>(rng() & 0xFF, 1)));
+			}
+			return add(unit, long_start_code);
+		}
+	};
+
+	/** What libobs considers the parameter sets and SEI of a packet. */
+	struct reference {
+		std::vector<uint8_t> header;
+		std::vector<uint8_t> sei;
+
+		reference(const std::vector<uint8_t>& packet)
+		{
+			uint8_t*    new_packet;
+			uint8_t*    new_header;
+			uint8_t*    new_sei;
+			std::size_t sz_packet, sz_header, sz_sei;
+			obs_extract_avc_headers(packet.data(), packet.size(), &new_packet, &sz_packet, &new_header, &sz_header,
+									&new_sei, &sz_sei);
+			header.assign(new_header, new_header + sz_header);
+			sei.assign(new_sei, new_sei + sz_sei);
+			bfree(new_packet);
+			bfree(new_header);
+			bfree(new_sei);
+		}
+	};
+
+	std::vector<uint8_t> concatenate(const std::array<h264::nal_view, h264::header_sei::max_units>& views,
+									 std::size_t                                                 count)
+	{
+		std::vector<uint8_t> data;
+		for (std::size_t idx = 0; idx < count; idx++) {
+			data.insert(data.end(), views[idx].data, views[idx].data + views[idx].size);
+		}
+		return data;
+	}
+
+	// The views into a packet must hold exactly the bytes libobs would have copied out of it, in the same order.
+	bool check_header_sei()
+	{
+		std::vector<std::pair<const char*, access_unit>> packets;
+
+		// x264 writes 4-byte start codes for parameter sets, SEI and the first slice, and 3-byte ones for the rest.
+		packets.emplace_back("x264 IDR, 2 slices", access_unit());
+		packets.back().second.add(sps, true).add(pps, true).add(sei_x264(), true);
+		packets.back().second.slice(0x65, 3000, true).slice(0x65, 2000, false);
+		packets.emplace_back("x264 P, 3 slices", access_unit());
+		packets.back().second.slice(0x41, 900, true).slice(0x41, 700, false).slice(0x41, 800, false);
+
+		// NVENC writes 4-byte start codes only, with an access unit delimiter first.
+		packets.emplace_back("NVENC IDR", access_unit());
+		packets.back().second.add(aud, true).add(sps, true).add(pps, true).add(sei_timing, true);
+		packets.back().second.slice(0x65, 4000, true);
+
+		// Other encoders use 3-byte start codes for everything.
+		packets.emplace_back("3-byte start codes", access_unit());
+		packets.back().second.add(sps, false).add(pps, false).add(sei_timing, false).add(sei_x264(), false);
+		packets.back().second.slice(0x65, 2500, false);
+
+		// Exactly as many SEI as fit into the views, and then one more which is left to libobs.
+		for (auto [name, count] : {std::make_pair("16 SEI", h264::header_sei::max_units),
+								   std::make_pair("17 SEI", h264::header_sei::max_units + 1)}) {
+			packets.emplace_back(name, access_unit());
+			packets.back().second.add(sps, true).add(pps, true);
+			for (std::size_t idx = 0; idx < count; idx++) {
+				packets.back().second.add(sei_timing, (idx % 2) == 0);
+			}
+			packets.back().second.slice(0x65, 1000, true);
+		}
+
+		bool ok = true;
+		for (auto& [name, packet] : packets) {
+			reference        expected(packet.data);
+			h264::header_sei units;
+			bool             fits     = h264::extract_header_sei(packet.data.data(), packet.data.size(), units);
+			bool             too_many = (std::strcmp(name, "17 SEI") == 0);
+
+			if (!fits || too_many) {
+				// Only too many units of a kind may fail, the caller then falls back to libobs.
+				std::printf("  %-20s: %s\n", name,
+							fits ? "DIFFERENT, should have been too many units"
+								 : (too_many ? "too many units, falls back to libobs" : "FAILED"));
+				ok &= (fits != too_many);
+				continue;
+			}
+
+			bool same = (concatenate(units.header, units.header_count) == expected.header)
+						&& (concatenate(units.sei, units.sei_count) == expected.sei);
+			std::printf("  %-20s: %zu header and %zu SEI units, %s\n", name, units.header_count, units.sei_count,
+						same ? "identical to libobs" : "DIFFERENT from libobs");
+			ok &= same;
+		}
+		return ok;
+	}
+
+	streamfx::benchmark::registration _header_sei("h264.header_sei", true, check_header_sei);
+} // namespace
@@ -0,0 +1,139 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// The thread pool as it was before work-stealing, kept only as the baseline for threadpool-benchmark.cpp: a single
+// mutex guarded list, one condition variable, and twice as many workers as there are hardware threads.
+
+namespace streamfx::benchmark::legacy {
+	typedef std::shared_ptr<void>                  threadpool_data_t;
+	typedef std::function<void(threadpool_data_t)> threadpool_callback_t;
+
+	class threadpool {
+		public:
+		class task {
+			std::mutex              _mutex;
+			std::condition_variable _is_complete;
+			std::atomic<bool>       _is_dead;
+			threadpool_callback_t   _callback;
+			threadpool_data_t       _data;
+
+			public:
+			task(threadpool_callback_t callback_function, threadpool_data_t data)
+				: _mutex(), _is_complete(), _is_dead(false), _callback(callback_function), _data(data)
+			{}
+
+			void await_completion()
+			{
+				if (!_is_dead) {
+					std::unique_lock<std::mutex> lock(_mutex);
+					_is_complete.wait(lock, [this]() { return this->_is_dead.load(); });
+				}
+			}
+
+			friend class threadpool;
+		};
+
+		private:
+		std::list<std::thread>           _workers;
+		std::atomic<bool>                _worker_stop;
+		std::list<std::shared_ptr<task>> _tasks;
+		std::mutex                       _tasks_lock;
+		std::condition_variable          _tasks_cv;
+
+		public:
+		threadpool() : _workers(), _worker_stop(false), _tasks(), _tasks_lock(), _tasks_cv()
+		{
+			std::size_t concurrency = static_cast<size_t>(std::thread::hardware_concurrency() * 2);
+			for (std::size_t n = 0; n < concurrency; n++) {
+				_workers.emplace_back(std::bind(&threadpool::work, this));
+			}
+		}
+
+		~threadpool()
+		{
+			_worker_stop = true;
+			_tasks_cv.notify_all();
+			for (auto& thread : _workers) {
+				_tasks_cv.notify_all();
+				if (thread.joinable()) {
+					thread.join();
+				}
+			}
+		}
+
+		std::shared_ptr<task> push(threadpool_callback_t fn, threadpool_data_t data)
+		{
+			auto                         task = std::make_shared<threadpool::task>(fn, data);
+			std::unique_lock<std::mutex> lock(_tasks_lock);
+			_tasks.emplace_back(task);
+			_tasks_cv.notify_one();
+			return task;
+		}
+
+		std::size_t concurrency() const
+		{
+			return _workers.size();
+		}
+
+		private:
+		void work()
+		{
+			std::shared_ptr<task> local_work{};
+			while (!_worker_stop) {
+				{
+					std::unique_lock<std::mutex> lock(_tasks_lock);
+					if (_tasks.size() == 0) {
+						_tasks_cv.wait(lock, [this]() { return _worker_stop || _tasks.size() > 0; });
+					}
+					if (_worker_stop || (_tasks.size() == 0)) {
+						continue;
+					}
+					local_work = _tasks.front();
+					_tasks.pop_front();
+				}
+
+				if (local_work->_is_dead.load()) {
+					continue;
+				}
+
+				if (local_work->_callback) {
+					try {
+						local_work->_callback(local_work->_data);
+					} catch (...) {
+					}
+					{
+						std::unique_lock<std::mutex> lock(local_work->_mutex);
+						local_work->_is_dead.store(true);
+					}
+					local_work->_is_complete.notify_all();
+				}
+				local_work.reset();
+			}
+		}
+	};
+} // namespace streamfx::benchmark::legacy
@@ -0,0 +1,156 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+// Micro benchmark: runs checks and measurements of StreamFX's building blocks directly, without loading the module.
+// Checks compare optimized code against a plain reference and fail the run on any difference, benchmarks only report.
+// CTest runs all checks, benchmarks are meant to be run by hand on the machine in question.
+
+#include "benchmark.hpp"
+#include <cstdarg>
+#include <cstdlib>
+#include <stdexcept>
+#include "plugin.hpp"
+
+static std::shared_ptr<streamfx::util::threadpool> _threadpool;
+
+std::shared_ptr<streamfx::util::threadpool> streamfx::threadpool()
+{
+	return _threadpool;
+}
+
+// Without the module there are no translations, so keys are shown as they are.
+MODULE_EXPORT const char* obs_module_text(const char* text)
+{
+	return text;
+}
+
+std::vector<streamfx::benchmark::entry>& streamfx::benchmark::entries()
+{
+	static std::vector<entry> list;
+	return list;
+}
+
+namespace {
+	struct options {
+		bool                     checks     = true;
+		bool                     benchmarks = true;
+		bool                     list       = false;
+		bool                     verbose    = false;
+		std::size_t              threads    = 0;
+		std::vector<std::string> filters;
+	};
+
+	void log_handler(int level, const char* message, va_list args, void* param)
+	{
+		auto* opts = reinterpret_cast<options*>(param);
+		if (opts->verbose || (level <= LOG_ERROR)) {
+			std::vfprintf(stderr, message, args);
+			std::fputc('\n', stderr);
+		}
+	}
+
+	bool matches(const options& opts, const std::string& name)
+	{
+		if (opts.filters.empty()) {
+			return true;
+		}
+		for (auto& filter : opts.filters) {
+			if ((name == filter) || ((name.size() > filter.size()) && (name.compare(0, filter.size(), filter) == 0)
+									 && (name[filter.size()] == '.'))) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void usage(const char* self)
+	{
+		std::printf("Usage: %s [options] [<name>...]\n"
+					"\n"
+					"  <name>               Only run entries with this name, or below it like 'threadpool' for\n"
+					"                       'threadpool.throughput'.\n"
+					"  --checks             Only run checks.\n"
+					"  --benchmarks         Only run benchmarks.\n"
+					"  --threads <count>    Worker threads of the shared thread pool. Default: hardware threads\n"
+					"  --list               List everything that can be run.\n"
+					"  --verbose            Show everything StreamFX logs.\n",
+					self);
+	}
+} // namespace
+
+int main(int argc, const char* argv[])
+try {
+	options opts;
+	for (int idx = 1; idx < argc; idx++) {
+		std::string arg = argv[idx];
+		if (arg == "--checks") {
+			opts.benchmarks = false;
+		} else if (arg == "--benchmarks") {
+			opts.checks = false;
+		} else if ((arg == "--threads") && (idx + 1 < argc)) {
+			opts.threads = static_cast<std::size_t>(std::stoul(argv[++idx]));
+		} else if (arg == "--list") {
+			opts.list = true;
+		} else if (arg == "--verbose") {
+			opts.verbose = true;
+		} else if ((arg.size() > 0) && (arg[0] != '-')) {
+			opts.filters.push_back(arg);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (opts.list) {
+		for (auto& entry : streamfx::benchmark::entries()) {
+			std::printf("%-32s %s\n", entry.name.c_str(), entry.is_check ? "check" : "benchmark");
+		}
+		return 0;
+	}
+
+	base_set_log_handler(log_handler, &opts);
+	_threadpool = std::make_shared<streamfx::util::threadpool>(opts.threads);
+
+	std::size_t ran    = 0;
+	std::size_t failed = 0;
+	for (auto& entry : streamfx::benchmark::entries()) {
+		if (!matches(opts, entry.name) || !(entry.is_check ? opts.checks : opts.benchmarks)) {
+			continue;
+		}
+
+		std::printf("[%s]\n", entry.name.c_str());
+		std::fflush(stdout);
+		bool passed = false;
+		try {
+			passed = entry.function();
+		} catch (const std::exception& ex) {
+			std::printf("  Exception: %s\n", ex.what());
+		}
+		std::printf("  %s\n", passed ? "Passed" : "FAILED");
+		ran++;
+		failed += passed ? 0 : 1;
+	}
+
+	_threadpool.reset();
+	std::printf("\n%zu run, %zu failed.\n", ran, failed);
+	return ((ran == 0) || (failed > 0)) ? 1 : 0;
+} catch (const std::exception& ex) {
+	std::fprintf(stderr, "Unexpected exception: %s\n", ex.what());
+	return 1;
+}
@@ -0,0 +1,174 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <random>
+#include "benchmark.hpp"
+#include "encoders/codecs/nal.hpp"
+
+// Random packets compared against the reference search, each at every offset.
+#define ST_FUZZ_PACKETS 20000
+
+// Size of the packet scanned by the throughput benchmark, about a 4K key frame.
+#define ST_PACKET_SIZE (8 << 20)
+
+using namespace streamfx::encoder::codec;
+
+namespace {
+	// Byte by byte, exactly as the specification describes it.
+	const uint8_t* reference_find(const uint8_t* ptr, const uint8_t* end)
+	{
+		for (; (end - ptr) >= 3; ptr++) {
+			if ((ptr[0] == 0) && (ptr[1] == 0) && (ptr[2] == 1)) {
+				return ptr;
+			}
+		}
+		return end;
+	}
+
+	// The same rules nal::index() documents, built on the reference search.
+	std::vector<nal::unit> reference_index(const uint8_t* data, std::size_t size, nal::format fmt)
+	{
+		std::vector<nal::unit> units;
+		const uint8_t*         end         = data + size;
+		std::size_t            header_size = (fmt == nal::format::HEVC) ? 2 : 1;
+		for (const uint8_t* ptr = reference_find(data, end); ptr != end;) {
+			const uint8_t* payload = ptr + 3;
+			const uint8_t* next    = reference_find(payload, end);
+			const uint8_t* start   = ((ptr > data) && (ptr[-1] == 0)) ? ptr - 1 : ptr;
+			const uint8_t* last    = next;
+			while ((last > payload) && (last[-1] == 0)) {
+				--last;
+			}
+
+			if (static_cast<std::size_t>(last - payload) >= header_size) {
+				nal::unit u = {};
+				u.offset    = static_cast<std::size_t>(start - data);
+				u.size      = static_cast<std::size_t>(last - start);
+				u.prefix    = static_cast<uint8_t>(payload - start);
+				if (fmt == nal::format::HEVC) {
+					u.type        = static_cast<uint8_t>((payload[0] >> 1) & 0x3F);
+					u.layer       = static_cast<uint8_t>(((payload[0] & 0x1) << 5) | (payload[1] >> 3));
+					u.temporal_id = static_cast<uint8_t>((payload[1] & 0x7) - 1);
+				} else {
+					u.type = static_cast<uint8_t>(payload[0] & 0x1F);
+				}
+				units.push_back(u);
+			}
+			ptr = next;
+		}
+		return units;
+	}
+
+	bool same(const nal::unit& a, const nal::unit& b)
+	{
+		return (a.offset == b.offset) && (a.size == b.size) && (a.prefix == b.prefix) && (a.type == b.type)
+			   && (a.layer == b.layer) && (a.temporal_id == b.temporal_id);
+	}
+
+	// The vectorized scanners look at blocks of 16 or 32 bytes, so start codes across and right at the end of a block
+	// are where they would go wrong. Mostly zeros and ones makes start codes and near misses frequent.
+	bool check_scanner()
+	{
+		std::mt19937           rng(1);
+		std::vector<nal::unit> units;
+		std::size_t            checks = 0;
+
+		for (std::size_t packet = 0; packet < ST_FUZZ_PACKETS; packet++) {
+			std::vector<uint8_t> data(rng() % 200);
+			uint32_t             mode = rng() % 3;
+			for (auto& value : data) {
+				uint32_t bits = rng();
+				if (mode == 0) {
+					value = static_cast<uint8_t>(bits % 3);
+				} else if (mode == 1) {
+					value = static_cast<uint8_t>((bits % 8 == 0) ? 0 : ((bits % 16 == 1) ? 1 : (bits >> 8)));
+				} else {
+					value = static_cast<uint8_t>(bits);
+				}
+			}
+
+			const uint8_t* begin = data.data();
+			const uint8_t* end   = begin + data.size();
+			for (std::size_t offset = 0; offset <= data.size(); offset++, checks++) {
+				if (nal::find_start_code(begin + offset, end) != reference_find(begin + offset, end)) {
+					std::printf("  find_start_code() differs for %zu bytes at offset %zu.\n", data.size(), offset);
+					return false;
+				}
+			}
+
+			for (auto fmt : {nal::format::H264, nal::format::HEVC}) {
+				auto expected = reference_index(begin, data.size(), fmt);
+				nal::index(begin, data.size(), fmt, units);
+				bool equal = (units.size() == expected.size());
+				for (std::size_t idx = 0; equal && (idx < units.size()); idx++) {
+					equal = same(units[idx], expected[idx]);
+				}
+				if (!equal) {
+					std::printf("  index() differs for %zu bytes: %zu units, expected %zu.\n", data.size(),
+								units.size(), expected.size());
+					return false;
+				}
+				checks++;
+			}
+		}
+
+		std::printf("  %zu checks passed with the %s scanner.\n", checks, nal::scanner_name());
+		return true;
+	}
+
+	bool benchmark_scanner()
+	{
+		// Slice data never contains 0x000000 to 0x000002, emulation prevention makes sure of that. Nonzero noise is
+		// the closest to it, with start codes as often as a slice would have them.
+		std::mt19937           rng(1);
+		std::vector<uint8_t>   data(ST_PACKET_SIZE);
+		std::vector<nal::unit> units;
+		units.reserve(1024);
+
+		std::printf("  %-24s | %8s | %12s | %12s\n", "Packet", "Units", "index()", "Reference");
+		for (std::size_t spacing : {std::size_t(65536), std::size_t(1024)}) {
+			for (auto& value : data) {
+				value = static_cast<uint8_t>(std::max<uint32_t>(rng() & 0xFF, 1));
+			}
+			for (std::size_t offset = 0; (offset + 5) < data.size(); offset += spacing) {
+				data[offset + 0] = 0;
+				data[offset + 1] = 0;
+				data[offset + 2] = 0;
+				data[offset + 3] = 1;
+				data[offset + 4] = 0x26; // Slice segment of an IRAP picture.
+			}
+
+			std::size_t count = 0;
+
+			double indexed   = streamfx::benchmark::measure(
+				[&]() { count = nal::index(data.data(), data.size(), nal::format::HEVC, units); });
+			double reference = streamfx::benchmark::measure(
+				[&]() { count = reference_index(data.data(), data.size(), nal::format::HEVC).size(); });
+
+			std::printf("  8 MiB, unit every %-6zu | %8zu | %6.2f GiB/s | %6.2f GiB/s\n", spacing, count,
+						streamfx::benchmark::gibps(static_cast<double>(data.size()), indexed),
+						streamfx::benchmark::gibps(static_cast<double>(data.size()), reference));
+		}
+		std::printf("  Scanner: %s\n", nal::scanner_name());
+		return true;
+	}
+
+	streamfx::benchmark::registration _scanner("nal.scanner", true, check_scanner);
+	streamfx::benchmark::registration _throughput("nal.scanner.throughput", false, benchmark_scanner);
+} // namespace
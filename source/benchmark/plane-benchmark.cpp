@@ -0,0 +1,113 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <cstring>
+#include <random>
+#include "benchmark.hpp"
+#include "plugin.hpp"
+#include "util/util-plane.hpp"
+
+// Value of every byte that must not be written to.
+#define ST_GUARD 0xA5
+
+namespace {
+	// Only the requested bytes of each row may change, whatever the alignment and stride.
+	bool check_copy()
+	{
+		std::mt19937 rng(1);
+		bool         ok = true;
+
+		for (auto size : {std::make_pair(1920, 1080), std::make_pair(3840, 2160), std::make_pair(13, 7)}) {
+			for (std::size_t width : {std::size_t(size.first), std::size_t(size.first - 7), std::size_t(1)}) {
+				for (std::size_t offset : {0, 1, 3}) {
+					std::size_t          height        = static_cast<std::size_t>(size.second);
+					std::size_t          source_stride = static_cast<std::size_t>(size.first) + 64;
+					std::size_t          target_stride = static_cast<std::size_t>(size.first) + 32 + offset;
+					std::vector<uint8_t> source(source_stride * height + offset);
+					std::vector<uint8_t> target(target_stride * height + offset);
+					for (auto& value : source) {
+						value = static_cast<uint8_t>(rng());
+					}
+
+					for (auto pool : {std::shared_ptr<streamfx::util::threadpool>(), streamfx::threadpool()}) {
+						std::fill(target.begin(), target.end(), ST_GUARD);
+						streamfx::util::plane::copy(target.data() + offset, target_stride, source.data() + offset,
+													source_stride, width, height, pool);
+
+						bool same = true;
+						for (std::size_t idx = 0; idx < target.size(); idx++) {
+							std::size_t row      = (idx - offset) / target_stride;
+							std::size_t col      = (idx - offset) % target_stride;
+							bool        copied   = (idx >= offset) && (row < height) && (col < width);
+							uint8_t     expected = copied ? source[offset + row * source_stride + col] : ST_GUARD;
+							same &= (target[idx] == expected);
+						}
+						if (!same) {
+							std::printf("  %zux%zu at offset %zu %s the pool: DIFFERENT\n", width, height, offset,
+										pool ? "with" : "without");
+						}
+						ok &= same;
+					}
+				}
+			}
+		}
+		return ok;
+	}
+
+	bool benchmark_copy()
+	{
+		auto pool = streamfx::threadpool();
+		std::printf("  %-24s | %11s | %11s | %11s | %11s\n", "Plane", "memcpy", "Rows", "copy", "copy+pool");
+		for (auto size : {std::make_pair(1920, 1080), std::make_pair(2560, 1440), std::make_pair(3840, 2160)}) {
+			// Luma and the interleaved chroma plane of NV12, with OBS's and FFmpeg's differing strides.
+			for (std::size_t plane = 0; plane < 2; plane++) {
+				std::size_t          width  = static_cast<std::size_t>(size.first);
+				std::size_t          height = static_cast<std::size_t>(size.second) >> plane;
+				std::size_t          stride = width + 64;
+				std::vector<uint8_t> source(stride * height, 1);
+				std::vector<uint8_t> target(stride * height, 2);
+				double               bytes = static_cast<double>(width * height);
+
+				// A single memcpy of the whole plane is the limit, which only works if both strides are identical.
+				double flat = streamfx::benchmark::measure(
+					[&]() { std::memcpy(target.data(), source.data(), stride * height); });
+				double rows = streamfx::benchmark::measure([&]() {
+					for (std::size_t row = 0; row < height; row++) {
+						std::memcpy(target.data() + row * stride, source.data() + row * stride, width);
+					}
+				});
+				double copy = streamfx::benchmark::measure([&]() {
+					streamfx::util::plane::copy(target.data(), stride, source.data(), stride, width, height);
+				});
+				double pooled = streamfx::benchmark::measure([&]() {
+					streamfx::util::plane::copy(target.data(), stride, source.data(), stride, width, height, pool);
+				});
+
+				std::printf("  %4dx%-4d %-14s | %5.1f GiB/s | %5.1f GiB/s | %5.1f GiB/s | %5.1f GiB/s\n", size.first,
+							size.second, plane ? "chroma" : "luma", streamfx::benchmark::gibps(bytes, flat),
+							streamfx::benchmark::gibps(bytes, rows), streamfx::benchmark::gibps(bytes, copy),
+							streamfx::benchmark::gibps(bytes, pooled));
+			}
+		}
+		return true;
+	}
+
+	streamfx::benchmark::registration _copy("plane.copy", true, check_copy);
+	streamfx::benchmark::registration _throughput("plane.copy.throughput", false, benchmark_copy);
+} // namespace
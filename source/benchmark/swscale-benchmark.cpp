@@ -0,0 +1,194 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <random>
+#include "benchmark.hpp"
+#include "ffmpeg/swscale.hpp"
+
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4242 4244 4365)
+#endif
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
+namespace {
+	// Conversions an encoder commonly asks for: repacking, reducing bit depth with dithering, and RGB to YUV.
+	const std::pair<AVPixelFormat, AVPixelFormat> conversions[] = {
+		{AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P},
+		{AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P},
+		{AV_PIX_FMT_BGRA, AV_PIX_FMT_YUV444P},
+	};
+
+	/** A frame allocated the way av_frame_get_buffer() would, filled with noise for source frames. */
+	struct image {
+		uint8_t*      data[4]     = {nullptr, nullptr, nullptr, nullptr};
+		int           linesize[4] = {0, 0, 0, 0};
+		int           width;
+		int           height;
+		AVPixelFormat format;
+
+		image(int width, int height, AVPixelFormat format) : width(width), height(height), format(format)
+		{
+			if (av_image_alloc(data, linesize, width, height, format, 32) < 0) {
+				throw std::runtime_error("Failed to allocate image.");
+			}
+		}
+
+		~image()
+		{
+			av_freep(&data[0]);
+		}
+
+		image(const image&) = delete;
+		image& operator=(const image&) = delete;
+
+		int rows(int plane) const
+		{
+			int h_shift, v_shift;
+			av_pix_fmt_get_chroma_sub_sample(format, &h_shift, &v_shift);
+			return ((plane == 1) || (plane == 2)) ? AV_CEIL_RSHIFT(height, v_shift) : height;
+		}
+
+		void fill(uint32_t seed)
+		{
+			// High bit depth samples are kept within their range, anything else would only test clipping.
+			const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+			uint16_t                  mask = static_cast<uint16_t>((1 << desc->comp[0].depth) - 1);
+			std::mt19937              rng(seed);
+			for (int plane = 0; plane < av_pix_fmt_count_planes(format); plane++) {
+				int bytes = av_image_get_linesize(format, width, plane);
+				for (int row = 0; row < rows(plane); row++) {
+					uint8_t* ptr = data[plane] + static_cast<ptrdiff_t>(row) * linesize[plane];
+					if (desc->comp[0].depth > 8) {
+						for (int idx = 0; idx < bytes / 2; idx++) {
+							reinterpret_cast<uint16_t*>(ptr)[idx] = static_cast<uint16_t>(rng()) & mask;
+						}
+					} else {
+						for (int idx = 0; idx < bytes; idx++) {
+							ptr[idx] = static_cast<uint8_t>(rng());
+						}
+					}
+				}
+			}
+		}
+
+		bool operator==(const image& other) const
+		{
+			for (int plane = 0; plane < av_pix_fmt_count_planes(format); plane++) {
+				std::size_t bytes = static_cast<std::size_t>(av_image_get_linesize(format, width, plane));
+				for (int row = 0; row < rows(plane); row++) {
+					if (std::memcmp(data[plane] + static_cast<ptrdiff_t>(row) * linesize[plane],
+									other.data[plane] + static_cast<ptrdiff_t>(row) * other.linesize[plane], bytes)
+						!= 0) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+	};
+
+	/** A converter set up like the FFmpeg encoder does it. */
+	std::unique_ptr<streamfx::ffmpeg::swscale> make_scaler(int width, int height, AVPixelFormat source,
+														   AVPixelFormat target, uint32_t slices)
+	{
+		auto scaler = std::make_unique<streamfx::ffmpeg::swscale>();
+		scaler->set_source_size(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		scaler->set_source_format(source);
+		scaler->set_source_color(false, AVCOL_SPC_BT709);
+		scaler->set_target_size(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		scaler->set_target_format(target);
+		scaler->set_target_color(false, AVCOL_SPC_BT709);
+		scaler->set_slices(slices);
+		if (!scaler->initialize(SWS_POINT)) {
+			throw std::runtime_error("Failed to initialize converter.");
+		}
+		return scaler;
+	}
+
+	int32_t convert(streamfx::ffmpeg::swscale& scaler, const image& source, image& target)
+	{
+		return scaler.convert(source.data, source.linesize, 0, source.height, target.data, target.linesize);
+	}
+
+	// Converting in slices must give exactly what converting the frame as a whole gives.
+	bool check_slices()
+	{
+		bool ok = true;
+		for (auto& conversion : conversions) {
+			// Heights that don't split evenly into slices, or into 8 or 16 rows.
+			for (int height : {1080, 1082, 722}) {
+				image source(1280, height, conversion.first);
+				image whole(1280, height, conversion.second);
+				image sliced(1280, height, conversion.second);
+				source.fill(static_cast<uint32_t>(height));
+
+				auto single = make_scaler(1280, height, conversion.first, conversion.second, 1);
+				auto multi  = make_scaler(1280, height, conversion.first, conversion.second, 4);
+				convert(*single, source, whole);
+				convert(*multi, source, sliced);
+
+				bool same = (whole == sliced);
+				std::printf("  %-14s > %-14s %4d rows, %u slices: %s\n", av_get_pix_fmt_name(conversion.first),
+							av_get_pix_fmt_name(conversion.second), height, multi->get_slices(),
+							same ? "identical" : "DIFFERENT");
+				ok &= same && (multi->get_slices() > 1);
+			}
+		}
+
+		// Resampling chroma vertically would need rows of the neighbouring slices, so it is never sliced.
+		auto scaler = make_scaler(1280, 720, AV_PIX_FMT_BGRA, AV_PIX_FMT_YUV420P, 4);
+		std::printf("  %-14s > %-14s  720 rows, %u slices\n", "bgra", "yuv420p", scaler->get_slices());
+		ok &= (scaler->get_slices() == 1);
+
+		return ok;
+	}
+
+	bool benchmark_slices()
+	{
+		std::printf("  %-28s | %-9s | %10s | %10s | %6s\n", "Conversion", "Size", "Whole ms", "Sliced ms", "Slices");
+		for (auto& conversion : conversions) {
+			for (auto size : {std::make_pair(1920, 1080), std::make_pair(2560, 1440), std::make_pair(3840, 2160)}) {
+				image source(size.first, size.second, conversion.first);
+				image target(size.first, size.second, conversion.second);
+				source.fill(0);
+
+				auto   single = make_scaler(size.first, size.second, conversion.first, conversion.second, 1);
+				auto   multi  = make_scaler(size.first, size.second, conversion.first, conversion.second, 0);
+				double whole  = streamfx::benchmark::measure([&]() { convert(*single, source, target); }) / 1e6;
+				double sliced = streamfx::benchmark::measure([&]() { convert(*multi, source, target); }) / 1e6;
+
+				std::printf("  %-12s > %-13s | %4dx%-4d | %10.3f | %10.3f | %6u\n",
+							av_get_pix_fmt_name(conversion.first), av_get_pix_fmt_name(conversion.second), size.first,
+							size.second, whole, sliced, multi->get_slices());
+			}
+		}
+		return true;
+	}
+
+	streamfx::benchmark::registration _slices("ffmpeg.swscale.slices", true, check_slices);
+	streamfx::benchmark::registration _throughput("ffmpeg.swscale.throughput", false, benchmark_slices);
+} // namespace
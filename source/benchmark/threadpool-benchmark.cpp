@@ -0,0 +1,209 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "benchmark.hpp"
+#include "legacy-threadpool.hpp"
+#include "util/util-threadpool.hpp"
+
+// Tasks pushed in total by the producers of the throughput benchmark.
+#define ST_TASKS 200000
+
+// Threads pushing tasks at the same time, like several filters and encoders would.
+#define ST_PRODUCERS 4
+
+namespace {
+	// Busy work that the compiler can't remove.
+	void spin(std::size_t iterations)
+	{
+		volatile std::size_t value = 0;
+		for (std::size_t idx = 0; idx < iterations; idx++) {
+			value = value + idx;
+		}
+	}
+
+	/** Many producers pushing small tasks, returns tasks per second. */
+	template<typename T>
+	double throughput(T& pool, std::size_t work)
+	{
+		std::atomic<std::size_t> done{0};
+		auto                     start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> producers;
+		for (std::size_t idx = 0; idx < ST_PRODUCERS; idx++) {
+			producers.emplace_back([&pool, &done, work]() {
+				for (std::size_t n = 0; n < ST_TASKS / ST_PRODUCERS; n++) {
+					pool.push(
+						[&done, work](std::shared_ptr<void>) {
+							spin(work);
+							done.fetch_add(1, std::memory_order_relaxed);
+						},
+						nullptr);
+				}
+			});
+		}
+		for (auto& producer : producers) {
+			producer.join();
+		}
+		while (done.load() < (ST_TASKS / ST_PRODUCERS) * ST_PRODUCERS) {
+			std::this_thread::yield();
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return ST_TASKS / seconds;
+	}
+
+	/** One slice per worker pushed and awaited, like plane::copy does for every frame. Returns µs per round. */
+	template<typename T>
+	double fork_join(T& pool)
+	{
+		std::size_t slices = pool.concurrency();
+		return streamfx::benchmark::measure([&pool, slices]() {
+				   std::vector<std::shared_ptr<typename T::task>> tasks;
+				   tasks.reserve(slices);
+				   for (std::size_t idx = 0; idx < slices; idx++) {
+					   tasks.push_back(pool.push([](std::shared_ptr<void>) { spin(2000); }, nullptr));
+				   }
+				   for (auto& task : tasks) {
+					   task->await_completion();
+				   }
+			   })
+			   / 1000.;
+	}
+
+	/** A single task pushed and awaited, returns µs until it completed. */
+	template<typename T>
+	double round_trip(T& pool)
+	{
+		return streamfx::benchmark::measure(
+				   [&pool]() { pool.push([](std::shared_ptr<void>) {}, nullptr)->await_completion(); })
+			   / 1000.;
+	}
+
+	template<typename T>
+	void report(const char* name, T& pool)
+	{
+		std::printf("  %-12s %3zu workers | %12.0f | %12.0f | %10.1f | %10.1f\n", name, pool.concurrency(),
+					throughput(pool, 0), throughput(pool, 1000), fork_join(pool), round_trip(pool));
+	}
+
+	bool benchmark_throughput()
+	{
+		std::printf("  %-24s | %12s | %12s | %10s | %10s\n", "Pool", "Empty task/s", "Small task/s", "Fork µs",
+					"Trip µs");
+		{
+			streamfx::benchmark::legacy::threadpool pool;
+			report("Legacy", pool);
+		}
+		{
+			streamfx::util::threadpool pool;
+			report("Current", pool);
+		}
+		return true;
+	}
+
+	// Queue depth is counted separately from the queues, and must never run ahead of or fall behind them.
+	bool check_queue_depth()
+	{
+		streamfx::util::threadpool pool(4);
+		std::atomic<bool>          stop{false};
+		std::atomic<std::size_t>   worst{0};
+
+		std::thread observer([&pool, &stop, &worst]() {
+			while (!stop.load()) {
+				std::size_t depth = pool.queue_depth(streamfx::util::threadpool::priority::INTERACTIVE);
+				std::size_t prev  = worst.load();
+				while ((depth > prev) && !worst.compare_exchange_weak(prev, depth)) {
+				}
+			}
+		});
+
+		std::atomic<std::size_t> done{0};
+		std::vector<std::thread> producers;
+		for (std::size_t idx = 0; idx < ST_PRODUCERS; idx++) {
+			producers.emplace_back([&pool, &done]() {
+				for (std::size_t n = 0; n < ST_TASKS / ST_PRODUCERS; n++) {
+					pool.push([&done](std::shared_ptr<void>) { done.fetch_add(1); }, nullptr);
+				}
+			});
+		}
+		for (auto& producer : producers) {
+			producer.join();
+		}
+		while (done.load() < (ST_TASKS / ST_PRODUCERS) * ST_PRODUCERS) {
+			std::this_thread::yield();
+		}
+		stop = true;
+		observer.join();
+
+		std::size_t remaining = pool.queue_depth(streamfx::util::threadpool::priority::INTERACTIVE);
+		std::printf("  Deepest queue: %zu of %d tasks, %zu left after completion.\n", worst.load(), ST_TASKS,
+					remaining);
+		return (worst.load() <= ST_TASKS) && (remaining == 0);
+	}
+
+	// Idle workers of every lane help out with real-time work, so a burst of it must reach all of them.
+	bool check_lanes()
+	{
+		streamfx::util::threadpool pool(4);
+		std::size_t                slices = pool.concurrency();
+		std::mutex                 lock;
+		std::condition_variable    cv;
+		std::size_t                started = 0;
+
+		// Give every worker time to go to sleep, this is about waking them up.
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		std::vector<std::shared_ptr<streamfx::util::threadpool::task>> tasks;
+		for (std::size_t idx = 0; idx < slices; idx++) {
+			tasks.push_back(pool.push(
+				[&lock, &cv, &started, slices](std::shared_ptr<void>) {
+					// Only returns once every slice is running at the same time, or after giving up on that.
+					std::unique_lock<std::mutex> ul(lock);
+					started++;
+					cv.notify_all();
+					cv.wait_for(ul, std::chrono::seconds(2), [&started, slices]() { return started == slices; });
+				},
+				nullptr, streamfx::util::threadpool::priority::REALTIME));
+		}
+
+		auto        start   = std::chrono::steady_clock::now();
+		bool        all     = false;
+		std::size_t running = 0;
+		{
+			std::unique_lock<std::mutex> ul(lock);
+			all     = cv.wait_for(ul, std::chrono::seconds(2), [&started, slices]() { return started == slices; });
+			running = started;
+		}
+		auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		for (auto& task : tasks) {
+			task->await_completion();
+		}
+
+		std::printf("  %zu of %zu real-time slices running at once after %.1f ms.\n", running, slices, ms);
+		return all;
+	}
+
+	streamfx::benchmark::registration _throughput("threadpool.throughput", false, benchmark_throughput);
+	streamfx::benchmark::registration _queue_depth("threadpool.queue_depth", true, check_queue_depth);
+	streamfx::benchmark::registration _lanes("threadpool.lanes", true, check_lanes);
+} // namespace
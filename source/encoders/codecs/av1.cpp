@@ -33,3 +33,194 @@ const char* streamfx::encoder::codec::av1::profile_to_string(profile p)
 		return "Unknown";
 	}
 }
+
+bool streamfx::encoder::codec::av1::next(const uint8_t* data, std::size_t size, std::size_t& position, obu& u)
+{
+	if (position >= size) {
+		return false;
+	}
+
+	// OBU header, see AV1 5.3.2.
+	std::size_t start  = position;
+	std::size_t ptr    = position;
+	uint8_t     header = data[ptr++];
+	if ((header & 0x80) != 0) { // obu_forbidden_bit
+		position = size;
+		return false;
+	}
+	u.type        = static_cast<obu_type>((header >> 3) & 0xF);
+	u.temporal_id = 0;
+	u.spatial_id  = 0;
+	if ((header & 0x4) != 0) { // obu_extension_flag
+		if (ptr >= size) {
+			position = size;
+			return false;
+		}
+		u.temporal_id = data[ptr] >> 5;
+		u.spatial_id  = (data[ptr] >> 3) & 0x3;
+		ptr++;
+	}
+
+	// Without obu_has_size_field, the OBU extends to the end of the packet.
+	std::size_t obu_size = size - ptr;
+	if ((header & 0x2) != 0) {
+		obu_size = 0;
+		for (std::size_t idx = 0;; idx++) {
+			if ((ptr >= size) || (idx == 8)) {
+				position = size;
+				return false;
+			}
+			uint8_t byte = data[ptr++];
+			obu_size |= static_cast<std::size_t>(byte & 0x7F) << (idx * 7);
+			if ((byte & 0x80) == 0)
+				break;
+		}
+		if (obu_size > (size - ptr)) {
+			position = size;
+			return false;
+		}
+	}
+
+	u.offset      = start;
+	u.header_size = static_cast<uint8_t>(ptr - start);
+	u.size        = u.header_size + obu_size;
+	position      = ptr + obu_size;
+	return true;
+}
+
+std::size_t streamfx::encoder::codec::av1::index(const uint8_t* data, std::size_t size, std::vector<obu>& units)
+{
+	units.clear();
+
+	obu u;
+	for (std::size_t position = 0; next(data, size, position, u);) {
+		units.push_back(u);
+	}
+
+	return units.size();
+}
+
+bool streamfx::encoder::codec::av1::parse_sequence_header(const uint8_t* payload, std::size_t size,
+														  sequence_header& header)
+{
+	if (size < 1) {
+		return false;
+	}
+
+	// See AV1 5.5.1
+	header.seq_profile                  = static_cast<profile>(payload[0] >> 5);
+	header.still_picture                = ((payload[0] >> 4) & 0x1) != 0;
+	header.reduced_still_picture_header = ((payload[0] >> 3) & 0x1) != 0;
+	return true;
+}
+
+bool streamfx::encoder::codec::av1::parse_frame_header(const uint8_t* payload, std::size_t size,
+													   const sequence_header* sequence, frame_header& header)
+{
+	// See AV1 5.9.2, which with a reduced still picture header only has key frames.
+	if (sequence && sequence->reduced_still_picture_header) {
+		header.show_existing_frame = false;
+		header.type                = frame_type::KEY;
+		header.show_frame          = true;
+		return true;
+	}
+
+	if (size < 1) {
+		return false;
+	}
+
+	header.show_existing_frame = (payload[0] & 0x80) != 0;
+	if (header.show_existing_frame) {
+		header.type       = frame_type::INTER;
+		header.show_frame = true;
+	} else {
+		header.type       = static_cast<frame_type>((payload[0] >> 5) & 0x3);
+		header.show_frame = ((payload[0] >> 4) & 0x1) != 0;
+	}
+	return true;
+}
+
+bool streamfx::encoder::codec::av1::find_sequence_header(const uint8_t* data, std::size_t size,
+														 const uint8_t*& header, std::size_t& header_size)
+{
+	obu u;
+	for (std::size_t position = 0; next(data, size, position, u);) {
+		if (u.type == obu_type::SEQUENCE_HEADER) {
+			header      = u.data(data);
+			header_size = u.size;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool streamfx::encoder::codec::av1::is_keyframe(const uint8_t* data, std::size_t size)
+{
+	sequence_header  sequence;
+	sequence_header* sequence_ptr = nullptr;
+
+	obu u;
+	for (std::size_t position = 0; next(data, size, position, u);) {
+		if (u.type == obu_type::SEQUENCE_HEADER) {
+			if (parse_sequence_header(u.payload(data), u.payload_size(), sequence)) {
+				sequence_ptr = &sequence;
+			}
+		} else if ((u.type == obu_type::FRAME_HEADER) || (u.type == obu_type::FRAME)) {
+			frame_header frame;
+			if (parse_frame_header(u.payload(data), u.payload_size(), sequence_ptr, frame)
+				&& !frame.show_existing_frame && (frame.type == frame_type::KEY) && frame.show_frame) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool streamfx::encoder::codec::av1::get_packet_priority(const uint8_t* data, std::size_t size, int& priority,
+														int& drop_priority)
+{
+	sequence_header  sequence;
+	sequence_header* sequence_ptr = nullptr;
+	bool             found        = false;
+
+	obu u;
+	for (std::size_t position = 0; next(data, size, position, u);) {
+		if (u.type == obu_type::SEQUENCE_HEADER) {
+			if (parse_sequence_header(u.payload(data), u.payload_size(), sequence)) {
+				sequence_ptr = &sequence;
+			}
+			continue;
+		} else if ((u.type != obu_type::FRAME_HEADER) && (u.type != obu_type::FRAME)) {
+			continue;
+		}
+
+		frame_header frame;
+		if (!parse_frame_header(u.payload(data), u.payload_size(), sequence_ptr, frame)) {
+			continue;
+		}
+
+		int frame_priority;
+		if (u.temporal_id > 0) {
+			// Frames only refer to their own or lower temporal layers, so higher layers can go as a whole.
+			frame_priority = 0; // OBS_NAL_PRIORITY_DISPOSABLE
+		} else if (frame.show_existing_frame) {
+			frame_priority = 1; // OBS_NAL_PRIORITY_LOW
+		} else if (frame.type == frame_type::KEY) {
+			frame_priority = frame.show_frame ? 3 : 2; // OBS_NAL_PRIORITY_HIGHEST : OBS_NAL_PRIORITY_HIGH
+		} else if ((frame.type != frame_type::INTER) || !frame.show_frame) {
+			// INTRA_ONLY_FRAME, SWITCH_FRAME, or a hidden frame that later frames are built from.
+			frame_priority = 2; // OBS_NAL_PRIORITY_HIGH
+		} else {
+			frame_priority = 1; // OBS_NAL_PRIORITY_LOW
+		}
+
+		// A temporal unit may carry several frames, the most important one decides.
+		priority = found ? std::max(priority, frame_priority) : frame_priority;
+		found    = true;
+	}
+
+	if (found) {
+		drop_priority = 2; // OBS_NAL_PRIORITY_HIGH
+	}
+	return found;
+}
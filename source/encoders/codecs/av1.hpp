@@ -33,4 +33,106 @@ namespace streamfx::encoder::codec::av1 {
 	};
 
 	const char* profile_to_string(profile p);
+
+	// See AV1 6.2.2
+	enum class obu_type : uint8_t {
+		SEQUENCE_HEADER        = 1,
+		TEMPORAL_DELIMITER     = 2,
+		FRAME_HEADER           = 3,
+		TILE_GROUP             = 4,
+		METADATA               = 5,
+		FRAME                  = 6,
+		REDUNDANT_FRAME_HEADER = 7,
+		TILE_LIST              = 8,
+		PADDING                = 15,
+	};
+
+	// See AV1 6.8.2
+	enum class frame_type : uint8_t {
+		KEY        = 0,
+		INTER      = 1,
+		INTRA_ONLY = 2,
+		SWITCH     = 3,
+	};
+
+	struct obu {
+		std::size_t offset;      // Offset of the OBU header in the packet.
+		std::size_t size;        // Size including the header.
+		uint8_t     header_size; // Size of the header, its extension and the size field.
+		obu_type    type;
+		uint8_t     temporal_id; // Always 0 without an extension header.
+		uint8_t     spatial_id;  // Always 0 without an extension header.
+
+		const uint8_t* data(const uint8_t* packet) const
+		{
+			return packet + offset;
+		}
+
+		const uint8_t* payload(const uint8_t* packet) const
+		{
+			return packet + offset + header_size;
+		}
+
+		std::size_t payload_size() const
+		{
+			return size - header_size;
+		}
+	};
+
+	/** Leading fields of a sequence header, which decide how frame headers are laid out. */
+	struct sequence_header {
+		profile seq_profile;
+		bool    still_picture;
+		bool    reduced_still_picture_header;
+	};
+
+	/** Leading fields of a frame header. */
+	struct frame_header {
+		bool       show_existing_frame;
+		frame_type type; // Only valid without show_existing_frame.
+		bool       show_frame;
+	};
+
+	/** Find the OBU at a position of a packet in the low overhead bitstream format, without allocating anything.
+	 *
+	 * \param position Where to continue parsing, start with 0. Updated to point past the returned OBU.
+	 *
+	 * \return true if an OBU was found and written to \ref u, false at the end of the packet or on malformed data.
+	 */
+	bool next(const uint8_t* data, std::size_t size, std::size_t& position, obu& u);
+
+	/** Index all OBUs of a packet.
+	 *
+	 * \param units Cleared and then filled with the OBUs in packet order.
+	 *
+	 * \return Number of OBUs found.
+	 */
+	std::size_t index(const uint8_t* data, std::size_t size, std::vector<obu>& units);
+
+	bool parse_sequence_header(const uint8_t* payload, std::size_t size, sequence_header& header);
+
+	/** Parse the leading fields of a frame header.
+	 *
+	 * \param sequence Sequence header in effect, or nullptr to assume there is no reduced still picture header.
+	 */
+	bool parse_frame_header(const uint8_t* payload, std::size_t size, const sequence_header* sequence,
+							frame_header& header);
+
+	/** Find the sequence header OBU of a packet, which is what muxers expect as extra data.
+	 *
+	 * \return true if found, with \ref header pointing into the packet.
+	 */
+	bool find_sequence_header(const uint8_t* data, std::size_t size, const uint8_t*& header, std::size_t& header_size);
+
+	/** Check if a temporal unit shows a key frame. */
+	bool is_keyframe(const uint8_t* data, std::size_t size);
+
+	/** Classify a temporal unit for the frame dropper, using the frame headers it contains.
+	 *
+	 * \param priority      OBS_NAL_PRIORITY_* of the packet itself.
+	 * \param drop_priority OBS_NAL_PRIORITY_* that later packets need to be kept once this one is dropped.
+	 *
+	 * \return false if the packet contains no frame header.
+	 */
+	bool get_packet_priority(const uint8_t* data, std::size_t size, int& priority, int& drop_priority);
 } // namespace streamfx::encoder::codec::av1
@@ -20,43 +20,22 @@
 // SOFTWARE.
 
 #include "h264.hpp"
+#include "nal.hpp"
 
-uint8_t* is_nal_start(uint8_t* ptr, uint8_t* end_ptr, size_t& size)
+uint8_t* streamfx::encoder::codec::h264::find_closest_nal(uint8_t* ptr, uint8_t* end_ptr, size_t& size)
 {
-	// Ensure that the remaining space actually can contain a prefix and NAL header.
-	if ((ptr + (3 + 1)) >= end_ptr)
-		return nullptr;
+	auto nal_ptr = const_cast<uint8_t*>(nal::find_start_code(ptr, end_ptr));
 
-	if (*ptr != 0x0)
-		return nullptr;
-	if (*(ptr + 1) != 0x0)
+	// Ensure that the remaining space actually can contain a prefix and NAL header.
+	if ((end_ptr - nal_ptr) < (3 + 1))
 		return nullptr;
 
-	// 3-Byte NAL prefix.
-	if (*(ptr + 2) == 0x1) {
+	if ((nal_ptr > ptr) && (*(nal_ptr - 1) == 0x0)) {
+		size = 4;
+	} else {
 		size = 3;
-		return ptr + 3;
 	}
-
-	// 4-Byte NAL Prefix
-	if ((ptr + (4 + 1)) >= end_ptr)
-		return nullptr;
-	if (*(ptr + 2) != 0x0)
-		return nullptr;
-	if (*(ptr + 3) != 0x01)
-		return nullptr;
-
-	size = 4;
-	return ptr + 4;
-}
-
-uint8_t* streamfx::encoder::codec::h264::find_closest_nal(uint8_t* ptr, uint8_t* end_ptr, size_t& size)
-{
-	for (uint8_t* seek_ptr = ptr; seek_ptr < end_ptr; seek_ptr++) {
-		if (auto nal_ptr = is_nal_start(seek_ptr, end_ptr, size); nal_ptr != nullptr)
-			return nal_ptr;
-	}
-	return nullptr;
+	return nal_ptr + 3;
 }
 
 uint32_t streamfx::encoder::codec::h264::get_packet_reference_count(uint8_t* ptr, uint8_t* end_ptr)
@@ -85,3 +64,76 @@ uint32_t streamfx::encoder::codec::h264::get_packet_reference_count(uint8_t* ptr
 
 	return std::numeric_limits<uint32_t>::max();
 }
+
+bool streamfx::encoder::codec::h264::extract_header_sei(const uint8_t* data, std::size_t size, header_sei& result)
+{
+	result.header_count = 0;
+	result.sei_count    = 0;
+
+	nal::unit unit;
+	for (std::size_t position = 0; nal::next(data, size, nal::format::H264, position, unit);) {
+		switch (static_cast<nal_unit_type>(unit.type)) {
+		case nal_unit_type::SEQUENCE_PARAMETER_SET:
+		case nal_unit_type::PICTURE_PARAMETER_SET:
+			if (result.header_count == header_sei::max_units)
+				return false;
+			result.header[result.header_count++] = {unit.data(data), unit.size};
+			break;
+		case nal_unit_type::SUPPLEMENTAL_ENHANCEMENT_INFORMATION:
+			if (result.sei_count == header_sei::max_units)
+				return false;
+			result.sei[result.sei_count++] = {unit.data(data), unit.size};
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool streamfx::encoder::codec::h264::get_packet_priority(const uint8_t* data, std::size_t size, int& priority,
+														 int& drop_priority)
+{
+	nal::unit unit;
+	for (std::size_t position = 0; nal::next(data, size, nal::format::H264, position, unit);) {
+		auto type = static_cast<nal_unit_type>(unit.type);
+		if ((type != nal_unit_type::CODED_SLICE_IDR) && (type != nal_unit_type::CODED_SLICE_NONIDR)) {
+			continue;
+		}
+
+		const uint8_t* payload   = unit.payload(data);
+		bool           reference = ((payload[0] >> 5) & 0x3) != 0;
+
+		// Recovery only via IDR-Frame.
+		if (type == nal_unit_type::CODED_SLICE_IDR) {
+			priority      = 3; // OBS_NAL_PRIORITY_HIGHEST
+			drop_priority = 2; // OBS_NAL_PRIORITY_HIGH
+			return true;
+		}
+
+		uint32_t         first_mb_in_slice = 0;
+		uint32_t         slice_type        = 0;
+		nal::rbsp_reader reader(payload + 1, payload + unit.payload_size());
+		if (!reader.read_ue(first_mb_in_slice) || !reader.read_ue(slice_type)) {
+			priority      = reference ? 2 : 0; // OBS_NAL_PRIORITY_HIGH : OBS_NAL_PRIORITY_DISPOSABLE
+			drop_priority = 2;                 // OBS_NAL_PRIORITY_HIGH
+			return true;
+		}
+
+		switch (slice_type % 5) {
+		case 2: // I
+		case 4: // SI
+			priority = 2; // OBS_NAL_PRIORITY_HIGH
+			break;
+		default: // P, SP, B
+			// Nothing refers to a picture with nal_ref_idc 0, so it can always be dropped on its own.
+			priority = reference ? 1 : 0; // OBS_NAL_PRIORITY_LOW : OBS_NAL_PRIORITY_DISPOSABLE
+			break;
+		}
+		drop_priority = 2; // OBS_NAL_PRIORITY_HIGH
+		return true;
+	}
+
+	return false;
+}
@@ -96,4 +96,35 @@ namespace streamfx::encoder::codec::h264 {
 
 	uint32_t get_packet_reference_count(uint8_t* ptr, uint8_t* endptr);
 
+	/** A NAL unit inside a packet, including its start code. */
+	struct nal_view {
+		const uint8_t* data;
+		std::size_t    size;
+	};
+
+	/** Parameter sets and SEI of a packet, as views into the packet itself. */
+	struct header_sei {
+		static constexpr std::size_t max_units = 16;
+
+		std::array<nal_view, max_units> header; // SPS and PPS, in packet order.
+		std::size_t                     header_count;
+		std::array<nal_view, max_units> sei;
+		std::size_t                     sei_count;
+	};
+
+	/** Find the SPS, PPS and SEI units of a packet without copying or allocating anything.
+	 *
+	 * \return false if the packet holds more units of a kind than \ref header_sei::max_units.
+	 */
+	bool extract_header_sei(const uint8_t* data, std::size_t size, header_sei& result);
+
+	/** Classify an access unit for the frame dropper, using nal_ref_idc and the slice type of its first slice.
+	 *
+	 * \param priority      OBS_NAL_PRIORITY_* of the packet itself.
+	 * \param drop_priority OBS_NAL_PRIORITY_* that later packets need to be kept once this one is dropped.
+	 *
+	 * \return false if the packet contains no slice.
+	 */
+	bool get_packet_priority(const uint8_t* data, std::size_t size, int& priority, int& drop_priority);
+
 } // namespace streamfx::encoder::codec::h264
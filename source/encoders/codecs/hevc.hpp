@@ -61,4 +61,13 @@ namespace streamfx::encoder::codec::hevc {
 
 	void extract_header_sei(uint8_t* data, std::size_t sz_data, std::vector<uint8_t>& header,
 							std::vector<uint8_t>& sei);
+
+	/** Classify an access unit for the frame dropper, using the NAL unit type and temporal id of its first slice.
+	 *
+	 * \param priority      OBS_NAL_PRIORITY_* of the packet itself.
+	 * \param drop_priority OBS_NAL_PRIORITY_* that later packets need to be kept once this one is dropped.
+	 *
+	 * \return false if the packet contains no slice.
+	 */
+	bool get_packet_priority(const uint8_t* data, std::size_t size, int& priority, int& drop_priority);
 } // namespace streamfx::encoder::codec::hevc
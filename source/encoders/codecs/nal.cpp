@@ -0,0 +1,239 @@
+// Copyright (c) 2021 Michael Fabian Dirks <info@xaymar.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "nal.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ST_NAL_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define ST_NAL_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(ST_NAL_X86) && !defined(_MSC_VER)
+#define ST_TARGET(x) __attribute__((target(x)))
+#else
+#define ST_TARGET(x)
+#endif
+
+using namespace streamfx::encoder::codec;
+
+namespace {
+	typedef const uint8_t* (*find_t)(const uint8_t* ptr, const uint8_t* end);
+
+	// Looks at the third byte first, which rules out up to three positions at once in regular slice data.
+	const uint8_t* find_scalar(const uint8_t* ptr, const uint8_t* end)
+	{
+		while ((end - ptr) >= 3) {
+			if (ptr[2] > 1) {
+				ptr += 3;
+			} else if (ptr[2] == 0) {
+				ptr += 1;
+			} else if ((ptr[0] == 0) && (ptr[1] == 0)) {
+				return ptr;
+			} else {
+				ptr += 3;
+			}
+		}
+		return end;
+	}
+
+#ifdef ST_NAL_X86
+	inline uint32_t count_trailing_zeros(uint32_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, v);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(v));
+#endif
+	}
+
+	// Compares three overlapping loads, so every position in the block is checked against 0x00 0x00 0x01 at once.
+	ST_TARGET("avx2") const uint8_t* find_avx2(const uint8_t* ptr, const uint8_t* end)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one  = _mm256_set1_epi8(1);
+		for (; (end - ptr) >= (32 + 2); ptr += 32) {
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + 1));
+			__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + 2));
+			__m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)),
+										 _mm256_cmpeq_epi8(c, one));
+			if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m)); mask != 0) {
+				return ptr + count_trailing_zeros(mask);
+			}
+		}
+		return find_scalar(ptr, end);
+	}
+
+	const uint8_t* find_sse2(const uint8_t* ptr, const uint8_t* end)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one  = _mm_set1_epi8(1);
+		for (; (end - ptr) >= (16 + 2); ptr += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + 1));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + 2));
+			__m128i m =
+				_mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)), _mm_cmpeq_epi8(c, one));
+			if (uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m)); mask != 0) {
+				return ptr + count_trailing_zeros(mask);
+			}
+		}
+		return find_scalar(ptr, end);
+	}
+
+	bool has_avx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int leafs = info[0];
+
+		// AVX2 also needs the OS to save the upper halves of the registers.
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if ((leafs < 7) || !osxsave || ((_xgetbv(0) & 0x6) != 0x6)) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+#ifdef ST_NAL_NEON
+	// NEON has no movemask, so a hit only tells us the block contains a start code, which is then found by hand.
+	const uint8_t* find_neon(const uint8_t* ptr, const uint8_t* end)
+	{
+		const uint8x16_t zero = vdupq_n_u8(0);
+		const uint8x16_t one  = vdupq_n_u8(1);
+		for (; (end - ptr) >= (16 + 2); ptr += 16) {
+			uint8x16_t m = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(ptr), zero), vceqq_u8(vld1q_u8(ptr + 1), zero)),
+									vceqq_u8(vld1q_u8(ptr + 2), one));
+			if (vmaxvq_u8(m) != 0) {
+				return find_scalar(ptr, ptr + 16 + 2);
+			}
+		}
+		return find_scalar(ptr, end);
+	}
+#endif
+
+	struct kernel {
+		find_t      find;
+		const char* name;
+	};
+
+	const kernel& select_kernel()
+	{
+		static const kernel instance = []() {
+#ifdef ST_NAL_X86
+			if (has_avx2()) {
+				return kernel{find_avx2, "AVX2"};
+			}
+			return kernel{find_sse2, "SSE2"};
+#elif defined(ST_NAL_NEON)
+			return kernel{find_neon, "NEON"};
+#else
+			return kernel{find_scalar, "Scalar"};
+#endif
+		}();
+		return instance;
+	}
+} // namespace
+
+const uint8_t* nal::find_start_code(const uint8_t* ptr, const uint8_t* end)
+{
+	if (ptr >= end) {
+		return end;
+	}
+	return select_kernel().find(ptr, end);
+}
+
+bool nal::next(const uint8_t* data, std::size_t size, format fmt, std::size_t& position, unit& u)
+{
+	const uint8_t* end         = data + size;
+	find_t         find        = select_kernel().find;
+	std::size_t    header_size = (fmt == format::HEVC) ? 2 : 1;
+
+	for (const uint8_t* ptr = (position < size) ? find(data + position, end) : end; ptr != end;) {
+		const uint8_t* start   = ptr;
+		const uint8_t* payload = ptr + 3;
+		const uint8_t* next    = (payload < end) ? find(payload, end) : end;
+
+		// A NAL unit never ends with a zero byte, so any in front of the next start code are either trailing zeros
+		// or the leading zero of a 4-byte start code.
+		const uint8_t* last = next;
+		while ((last > payload) && (last[-1] == 0)) {
+			--last;
+		}
+		if ((start > data) && (start[-1] == 0)) {
+			--start;
+		}
+
+		if (static_cast<std::size_t>(last - payload) >= header_size) {
+			u.offset = static_cast<std::size_t>(start - data);
+			u.size   = static_cast<std::size_t>(last - start);
+			u.prefix = static_cast<uint8_t>(payload - start);
+			if (fmt == format::HEVC) {
+				u.type        = (payload[0] >> 1) & 0x3F;
+				u.layer       = static_cast<uint8_t>(((payload[0] & 0x1) << 5) | (payload[1] >> 3));
+				u.temporal_id = static_cast<uint8_t>((payload[1] & 0x7) - 1);
+			} else {
+				u.type        = payload[0] & 0x1F;
+				u.layer       = 0;
+				u.temporal_id = 0;
+			}
+			position = static_cast<std::size_t>(next - data);
+			return true;
+		}
+
+		ptr = next;
+	}
+
+	position = size;
+	return false;
+}
+
+std::size_t nal::index(const uint8_t* data, std::size_t size, format fmt, std::vector<unit>& units)
+{
+	units.clear();
+
+	unit u;
+	for (std::size_t position = 0; next(data, size, fmt, position, u);) {
+		units.push_back(u);
+	}
+
+	return units.size();
+}
+
+const char* nal::scanner_name()
+{
+	return select_kernel().name;
+}
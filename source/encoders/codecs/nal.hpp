@@ -0,0 +1,144 @@
+// Copyright (c) 2021 Michael Fabian Dirks <info@xaymar.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "common.hpp"
+
+namespace streamfx::encoder::codec::nal {
+	// How the header following a start code is laid out.
+	enum class format {
+		H264,
+		HEVC,
+	};
+
+	struct unit {
+		std::size_t offset;      // Offset of the start code in the packet.
+		std::size_t size;        // Size including the start code, excluding trailing zero bytes.
+		uint8_t     prefix;      // Length of the start code, 3 or 4.
+		uint8_t     type;        // nal_unit_type
+		uint8_t     layer;       // nuh_layer_id, always 0 for H.264.
+		uint8_t     temporal_id; // TemporalId, always 0 for H.264.
+
+		const uint8_t* data(const uint8_t* packet) const
+		{
+			return packet + offset;
+		}
+
+		// Header and payload, without the start code.
+		const uint8_t* payload(const uint8_t* packet) const
+		{
+			return packet + offset + prefix;
+		}
+
+		std::size_t payload_size() const
+		{
+			return size - prefix;
+		}
+	};
+
+	/** Reads bits from a NAL unit payload, skipping emulation prevention bytes. */
+	class rbsp_reader {
+		const uint8_t* _ptr;
+		const uint8_t* _end;
+		uint32_t       _zeros;
+		uint8_t        _byte;
+		uint8_t        _bits;
+
+		public:
+		rbsp_reader(const uint8_t* ptr, const uint8_t* end) : _ptr(ptr), _end(end), _zeros(0), _byte(0), _bits(0) {}
+
+		bool read_bit(uint32_t& value)
+		{
+			if (_bits == 0) {
+				if (_ptr >= _end)
+					return false;
+
+				uint8_t byte = *(_ptr++);
+				if ((_zeros >= 2) && (byte == 0x03)) {
+					if (_ptr >= _end)
+						return false;
+					byte = *(_ptr++);
+				}
+				_zeros = (byte == 0) ? (_zeros + 1) : 0;
+				_byte  = byte;
+				_bits  = 8;
+			}
+
+			value = (_byte >> (--_bits)) & 0x1;
+			return true;
+		}
+
+		// Unsigned Exp-Golomb, ue(v).
+		bool read_ue(uint32_t& value)
+		{
+			uint32_t leading = 0;
+			uint32_t bit     = 0;
+			while (true) {
+				if (!read_bit(bit))
+					return false;
+				if (bit != 0)
+					break;
+				if (++leading > 31)
+					return false;
+			}
+
+			value = 0;
+			for (uint32_t idx = 0; idx < leading; idx++) {
+				if (!read_bit(bit))
+					return false;
+				value = (value << 1) | bit;
+			}
+			value += (1u << leading) - 1;
+			return true;
+		}
+	};
+
+	/** Search for the next 3-byte start code (0x000001).
+	 *
+	 * \param ptr Beginning of the search range.
+	 * \param end End of the search range (exclusive).
+	 *
+	 * \return Pointer to the first byte of the start code, or \ref end if there is none.
+	 */
+	const uint8_t* find_start_code(const uint8_t* ptr, const uint8_t* end);
+
+	/** Find the NAL unit at or after a position, without allocating anything.
+	 *
+	 * \param position Where to continue the search, start with 0. Updated to point past the returned unit.
+	 *
+	 * \return true if a unit was found and written to \ref u.
+	 */
+	bool next(const uint8_t* data, std::size_t size, format fmt, std::size_t& position, unit& u);
+
+	/** Index all NAL units of an Annex-B packet in a single pass.
+	 *
+	 * A zero byte in front of a 3-byte start code is treated as part of a 4-byte start code. Units that are too short
+	 * to contain their header are skipped.
+	 *
+	 * \param units Cleared and then filled with the units in packet order. Keeping it around between packets avoids
+	 *              allocating again.
+	 *
+	 * \return Number of units found.
+	 */
+	std::size_t index(const uint8_t* data, std::size_t size, format fmt, std::vector<unit>& units);
+
+	/** Name of the scanner selected for this CPU, for logging. */
+	const char* scanner_name();
+} // namespace streamfx::encoder::codec::nal
@@ -21,7 +21,9 @@
 #include "encoder-aom-av1.hpp"
 #include <filesystem>
 #include <thread>
+#include "plugin.hpp"
 #include "util/util-logging.hpp"
+#include "util/util-plane.hpp"
 
 #ifdef _DEBUG
 #define ST_PREFIX "<%s> "
@@ -37,6 +39,12 @@
 #define D_LOG_DEBUG(...) P_LOG_DEBUG(ST_PREFIX __VA_ARGS__)
 #endif
 
+// Frames that may be waiting for or inside the encoder thread, each one holds an image of the ring.
+#define ST_ENCODE_QUEUE_INPUT 4
+
+// Alignment of rows in the image ring, frames from OBS must match this to be used without a copy.
+#define ST_IMAGE_ALIGN 8
+
 #define ST_I18N "Encoder.AOM.AV1"
 
 // Preset
@@ -60,6 +68,14 @@
 #define ST_I18N_ENCODER_CPUUSAGE_10 ST_I18N_ENCODER ".CPUUsage.10"
 #define ST_KEY_ENCODER_CPUUSAGE "Encoder.CPUUsage"
 #define ST_KEY_ENCODER_PROFILE "Encoder.Profile"
+#define ST_I18N_ENCODER_PASS ST_I18N_ENCODER ".Pass"
+#define ST_I18N_ENCODER_PASS_DESCRIPTION ST_I18N_ENCODER_PASS ".Description"
+#define ST_I18N_ENCODER_PASS_SINGLE ST_I18N_ENCODER_PASS ".Single"
+#define ST_I18N_ENCODER_PASS_FIRST ST_I18N_ENCODER_PASS ".First"
+#define ST_I18N_ENCODER_PASS_SECOND ST_I18N_ENCODER_PASS ".Second"
+#define ST_KEY_ENCODER_PASS "Encoder.Pass"
+#define ST_I18N_ENCODER_PASS_STATISTICS ST_I18N_ENCODER_PASS ".Statistics"
+#define ST_KEY_ENCODER_PASS_STATISTICS "Encoder.Pass.Statistics"
 
 // Rate Control
 #define ST_I18N_RATECONTROL ST_I18N ".RateControl"
@@ -108,6 +124,10 @@
 #define ST_KEY_ADVANCED_THREADS "Advanced.Threads"
 #define ST_I18N_ADVANCED_ROWMULTITHREADING ST_I18N_ADVANCED ".RowMultiThreading"
 #define ST_KEY_ADVANCED_ROWMULTITHREADING "Advanced.RowMultiThreading"
+#define ST_I18N_ADVANCED_ZEROCOPY ST_I18N_ADVANCED ".ZeroCopy"
+#define ST_KEY_ADVANCED_ZEROCOPY "Advanced.ZeroCopy"
+#define ST_I18N_ADVANCED_WARMPOOL ST_I18N_ADVANCED ".WarmPool"
+#define ST_KEY_ADVANCED_WARMPOOL "Advanced.WarmPool"
 #define ST_I18N_ADVANCED_TILE_COLUMNS ST_I18N_ADVANCED ".Tile.Columns"
 #define ST_KEY_ADVANCED_TILE_COLUMNS "Advanced.Tile.Columns"
 #define ST_I18N_ADVANCED_TILE_ROWS ST_I18N_ADVANCED ".Tile.Rows"
@@ -303,9 +323,35 @@ const char* aom_tune_content_to_string(aom_tune_content tune)
 	}
 }
 
+// Threading and tiling layouts by frame size, used for anything the user left at automatic. Tile counts are log2,
+// as libaom expects them. Tiles narrower than about 480 pixels cost more in compression than they gain in
+// parallelism, and past the thread limit libaom spends more time synchronizing its workers than encoding.
+//
+// Each row is meant to be the fastest layout of a benchmark sweep at that frame size, repeated for every core count
+// by restricting the process to that many cores, for example for 1080p on 8 cores:
+//   taskset -c 0-7 StreamFX-Benchmark --size 1920x1080 --frames 600 --run streamfx-aom-av1
+//     --sweep Encoder.CPUUsage=6,8,10 --sweep Advanced.Threads=2,4,8,12,16 --sweep Advanced.Tile.Columns=0,1,2,3
+// The values below have not been regenerated that way yet, they are still derived from the tile width limit above.
+struct aom_layout_t {
+	uint32_t samples;
+	int8_t   tile_columns;
+	int8_t   tile_rows;
+	int8_t   threads;
+};
+static constexpr aom_layout_t aom_layouts[] = {
+	{640 * 360, 0, 0, 2},   {1280 * 720, 1, 0, 4},   {1920 * 1080, 2, 0, 8},
+	{2560 * 1440, 2, 1, 12}, {3840 * 2160, 3, 1, 16}, {std::numeric_limits<uint32_t>::max(), 3, 2, 32},
+};
+
 aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bool is_hw)
 	: obs::encoder_instance(settings, self, is_hw), _factory(aom_av1_factory::get()), _iface(nullptr), _ctx(), _cfg(),
-	  _image_index(0), _images(), _global_headers(nullptr), _initialized(false), _settings()
+	  _image_index(0), _images(), _image_wrap(), _global_headers(nullptr), _initialized(false), _pooled(false),
+	  _settings(), _force_keyframe(false), _encode_thread(),
+	  _encode_lock(), _encode_cv(), _encode_stop(false), _encode_failed(false), _encode_busy(0), _encode_wrapped(false),
+	  _encode_input(), _encode_output(),
+	  _encode_current(), _encode_pool(), _encode_start(), _encode_lag(0), _context_lock(),
+	  _encode_pts(std::numeric_limits<int64_t>::min()), _encode_dts(std::numeric_limits<int64_t>::min()),
+	  _encode_step(0), _encode_reorder(0), _stats_out(), _stats_in()
 {
 	if (is_hw) {
 		throw std::runtime_error("Hardware encoding isn't even registered, how did you get here?");
@@ -322,6 +368,7 @@ aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bo
 	_profiler_copy   = streamfx::util::profiler::create();
 	_profiler_encode = streamfx::util::profiler::create();
 	_profiler_packet = streamfx::util::profiler::create();
+	_profiler_lag    = streamfx::util::profiler::create();
 #endif
 
 	{     // Generate Static Configuration
@@ -406,6 +453,25 @@ aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bo
 			}
 		}
 
+		{ // Multi-Pass
+			_settings.pass = static_cast<aom_enc_pass>(obs_data_get_int(settings, ST_KEY_ENCODER_PASS));
+			_settings.pass_stats =
+				std::filesystem::u8path(obs_data_get_string(settings, ST_KEY_ENCODER_PASS_STATISTICS));
+			if (_settings.pass == AOM_RC_FIRST_PASS) {
+				_stats_out.open(_settings.pass_stats, std::ios::binary | std::ios::trunc);
+				if (!_stats_out) {
+					D_LOG_ERROR("Failed to open '%s' for first-pass statistics.",
+								_settings.pass_stats.u8string().c_str());
+					throw std::runtime_error("Failed to open first-pass statistics.");
+				}
+			} else if (_settings.pass == AOM_RC_SECOND_PASS) {
+				// libaom wants the statistics of the whole encode at once, so they are mapped rather than read.
+				_stats_in = std::make_unique<streamfx::util::platform::mapped_file>(_settings.pass_stats);
+			} else {
+				_settings.pass = AOM_RC_ONE_PASS;
+			}
+		}
+
 		{ // Rate Control
 			_settings.rc_mode      = static_cast<aom_rc_mode>(obs_data_get_int(settings, ST_KEY_RATECONTROL_MODE));
 			_settings.rc_lookahead = static_cast<int8_t>(obs_data_get_int(settings, ST_KEY_RATECONTROL_LOOKAHEAD));
@@ -414,18 +480,65 @@ aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bo
 		{ // Threading
 			if (auto threads = obs_data_get_int(settings, ST_KEY_ADVANCED_THREADS); threads > 0) {
 				_settings.threads = static_cast<int8_t>(threads);
-			} else {
-				_settings.threads = std::thread::hardware_concurrency();
 			}
 			_settings.rowmultithreading =
 				static_cast<int8_t>(obs_data_get_int(settings, ST_KEY_ADVANCED_ROWMULTITHREADING));
 		}
 
+		{ // Zero-Copy
+			_settings.zero_copy =
+				streamfx::util::is_tristate_enabled(obs_data_get_int(settings, ST_KEY_ADVANCED_ZEROCOPY));
+		}
+
+		{ // Warm Pool
+			_settings.warm_pool =
+				streamfx::util::is_tristate_enabled(obs_data_get_int(settings, ST_KEY_ADVANCED_WARMPOOL));
+		}
+
 		{ // Tiling
 			_settings.tile_columns = static_cast<int8_t>(obs_data_get_int(settings, ST_KEY_ADVANCED_TILE_COLUMNS));
 			_settings.tile_rows    = static_cast<int8_t>(obs_data_get_int(settings, ST_KEY_ADVANCED_TILE_ROWS));
 		}
 
+		{ // Automatic Threading and Tiling
+			auto threads = obs_data_get_int(settings, ST_KEY_ADVANCED_THREADS);
+			auto preset  = obs_data_get_int(settings, ST_KEY_ENCODER_CPUUSAGE);
+			auto samples = static_cast<uint32_t>(_settings.width) * static_cast<uint32_t>(_settings.height);
+
+			const aom_layout_t* layout = aom_layouts;
+			while (samples > layout->samples) {
+				++layout;
+			}
+
+			if (threads <= 0) {
+				// The fastest presets do too little work per superblock row to keep many threads busy.
+				int64_t limit = (preset >= 8) ? std::max<int64_t>(layout->threads / 2, 1) : layout->threads;
+				int64_t cores = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+				_settings.threads     = static_cast<int8_t>(std::min(cores, limit));
+				_settings.auto_layout = true;
+			}
+			if ((_settings.tile_columns == -1) && (_settings.tile_rows == -1)) {
+				// More tiles than threads only costs compression, so give up rows first and columns second.
+				int8_t columns = layout->tile_columns;
+				int8_t rows    = layout->tile_rows;
+				while (((1 << (columns + rows)) > _settings.threads) && (rows > 0)) {
+					--rows;
+				}
+				while (((1 << columns) > _settings.threads) && (columns > 0)) {
+					--columns;
+				}
+				_settings.tile_columns = columns;
+				_settings.tile_rows    = rows;
+				_settings.auto_layout  = true;
+			}
+			if (_settings.rowmultithreading == -1) {
+				// Row-MT only pays off once there are more threads than tiles to hand out.
+				int tiles_log2 = std::max<int>(_settings.tile_columns, 0) + std::max<int>(_settings.tile_rows, 0);
+				_settings.rowmultithreading = (_settings.threads > (1 << tiles_log2)) ? 1 : 0;
+				_settings.auto_layout       = true;
+			}
+		}
+
 		{ // Tuning
 			if (auto v = obs_data_get_int(settings, ST_KEY_ADVANCED_TUNE_METRIC); v != -1) {
 				_settings.tune_metric = static_cast<aom_tune_metric>(v);
@@ -561,11 +674,8 @@ aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bo
 	// Preallocate global headers.
 	_global_headers = _factory->libaom_codec_get_global_headers(&_ctx);
 
-	// Allocate frames.
-	_images.resize(_cfg.g_threads);
-	for (auto& image : _images) {
-		_factory->libaom_img_alloc(&image, _settings.color_format, _settings.width, _settings.height, 8);
-
+	// Images only differ in where their planes are, everything else describes the stream.
+	auto describe = [this](aom_image_t& image) {
 		// Color Information.
 		image.fmt        = _settings.color_format;
 		image.cp         = _settings.color_primaries;
@@ -580,17 +690,66 @@ aom_av1_instance::aom_av1_instance(obs_data_t* settings, obs_encoder_t* self, bo
 		image.r_h = image.d_h;
 		image.r_w = image.w;
 		image.r_h = image.h;
+	};
+
+	// Allocate the image ring, which is consumed in order by the encoder thread.
+	_images.resize(ST_ENCODE_QUEUE_INPUT);
+	for (auto& image : _images) {
+		_factory->libaom_img_alloc(&image, _settings.color_format, _settings.width, _settings.height, ST_IMAGE_ALIGN);
+		describe(image);
 	}
 
+	// Zero-Copy only needs a description of the frame, its planes are pointed at OBS's memory for every frame.
+	_factory->libaom_img_wrap(&_image_wrap, _settings.color_format, _settings.width, _settings.height, ST_IMAGE_ALIGN,
+							  reinterpret_cast<unsigned char*>(ST_IMAGE_ALIGN));
+	describe(_image_wrap);
+
 	// Log Settings
 	log();
 
+	// Decode order, known before the first packet so that decode timestamps never have to jump ahead later. OBS
+	// advances presentation timestamps by the frame rate denominator. With look-ahead libaom places alt-ref frames,
+	// which are held back for one frame in the worst case.
+	_encode_step    = static_cast<int64_t>(_settings.fps.den);
+	_encode_reorder = (_cfg.g_lag_in_frames > 0) ? 1 : 0;
+
 	// Signal to future update() calls that we are fully initialized.
 	_initialized = true;
+
+	// From here on, libaom is driven by the encoder thread.
+	_encode_thread = std::thread(std::bind(&aom_av1_instance::encode_main, this));
 }
 
 aom_av1_instance::~aom_av1_instance()
 {
+	// Stop the encoder thread before anything it uses goes away.
+	if (_encode_thread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(_encode_lock);
+			_encode_stop = true;
+		}
+		_encode_cv.notify_all();
+		_encode_thread.join();
+	}
+
+	// The first pass only writes its summary once it is told that no more frames follow.
+	if (_settings.pass == AOM_RC_FIRST_PASS) {
+		// libaom may hold back packets for more than one call, so keep flushing until nothing comes out.
+		for (;;) {
+			if (auto error = _factory->libaom_codec_encode(&_ctx, nullptr, -1, 1, 0); error != AOM_CODEC_OK) {
+				const char* errstr = _factory->libaom_codec_err_to_string(error);
+				D_LOG_WARNING("Flushing the first pass failed with error: %s (code %" PRIu32 ")\n%s\n%s", errstr,
+							  error, _factory->libaom_codec_error(&_ctx), _factory->libaom_codec_error_detail(&_ctx));
+				break;
+			}
+			if (encode_drain() == 0) {
+				break;
+			}
+		}
+		_stats_out.close();
+		D_LOG_INFO("First-pass statistics written to '%s'.", _settings.pass_stats.u8string().c_str());
+	}
+
 #ifdef ENABLE_PROFILING
 	// Profiling
 	D_LOG_INFO("Timings | Avg. µs       | 99.9ile µs    | 99.0ile µs    | 95.0ile µs    | Samples  ", "");
@@ -613,6 +772,18 @@ aom_av1_instance::~aom_av1_instance()
 			   std::chrono::duration_cast<std::chrono::microseconds>(_profiler_packet->percentile(0.990)).count(),
 			   std::chrono::duration_cast<std::chrono::microseconds>(_profiler_packet->percentile(0.950)).count(),
 			   _profiler_packet->count());
+	D_LOG_INFO("Lag     | %13.1f | %13" PRId64 " | %13" PRId64 " | %13" PRId64 " | %9" PRIu64,
+			   _profiler_lag->average_duration() / 1000.,
+			   std::chrono::duration_cast<std::chrono::microseconds>(_profiler_lag->percentile(0.999)).count(),
+			   std::chrono::duration_cast<std::chrono::microseconds>(_profiler_lag->percentile(0.990)).count(),
+			   std::chrono::duration_cast<std::chrono::microseconds>(_profiler_lag->percentile(0.950)).count(),
+			   _profiler_lag->count());
+	if (auto total = _profiler_encode->total_duration(); total.count() > 0) {
+		D_LOG_INFO("Throughput: %.2f frames/s while encoding, peak lag of %" PRIuPTR " frames.",
+				   static_cast<double>(_profiler_encode->count())
+					   / std::chrono::duration_cast<std::chrono::duration<double>>(total).count(),
+				   _encode_lag);
+	}
 #endif
 
 	// Deallocate global buffer.
@@ -635,12 +806,20 @@ aom_av1_instance::~aom_av1_instance()
 
 	// Destroy encoder.
 	_factory->libaom_codec_destroy(&_ctx);
+
+	// Have the next start of this encoder ready by the time it is needed.
+	if (_settings.warm_pool && !_pooled) {
+		_factory->warm(_self);
+	}
 }
 
 void aom_av1_instance::migrate(obs_data_t* settings, uint64_t version) {}
 
 bool aom_av1_instance::update(obs_data_t* settings)
 {
+	// The encoder thread may be in the middle of a frame.
+	std::unique_lock<std::mutex> context_lock(_context_lock);
+
 	video_t*                        obsVideo      = obs_encoder_video(_self);
 	const struct video_output_info* obsVideoInfo  = video_output_get_info(obsVideo);
 	uint32_t                        obsFPSnum     = obsVideoInfo->fps_num;
@@ -701,7 +880,7 @@ bool aom_av1_instance::update(obs_data_t* settings)
 		}
 	}
 
-	{ // Configuration.
+	if (!_initialized) { // Configuration, which is static once the encoder is initialized.
 
 		{ // Usage and Defaults
 			_cfg.g_usage = static_cast<unsigned int>(obs_data_get_int(settings, ST_KEY_ENCODER_USAGE));
@@ -759,8 +938,12 @@ bool aom_av1_instance::update(obs_data_t* settings)
 
 		{ // Advanced
 
-			// Single-Pass
-			_cfg.g_pass = AOM_RC_ONE_PASS;
+			// Multi-Pass
+			_cfg.g_pass = _settings.pass;
+			if (_stats_in) {
+				_cfg.rc_twopass_stats_in.buf = const_cast<void*>(_stats_in->data());
+				_cfg.rc_twopass_stats_in.sz  = _stats_in->size();
+			}
 
 			// Threading
 			SET_IF_NOT_DEFAULT(_settings.threads, _cfg.g_threads);
@@ -787,21 +970,39 @@ bool aom_av1_instance::update(obs_data_t* settings)
 		//_cfg.full_still_picture_hdr = ?;
 		//_cfg.save_as_annexb = ?;
 		//_cfg.encoder_cfg = ?;
+	} else { // Rate Control and Key-Frames, which libaom can change while encoding.
+		aom_codec_enc_cfg_t cfg = _cfg;
 
-		// Apply configuration
-		if (_initialized) {
-			if (auto error = _factory->libaom_codec_enc_config_set(&_ctx, &_cfg); error != AOM_CODEC_OK) {
-				const char* errstr = _factory->libaom_codec_err_to_string(error);
-				const char* err    = _factory->libaom_codec_error(&_ctx);
-				const char* errdtl = _factory->libaom_codec_error_detail(&_ctx);
-				D_LOG_WARNING("Error changing configuration: %s (code %" PRIu32 ")%s%s%s%s", //
-							  (errstr ? errstr : ""), error,                                 //
-							  (err ? "\n\tMessage: " : ""), (err ? err : ""),                //
-							  (errdtl ? "\n\tDetails: " : ""), (errdtl ? errdtl : "")        //
-				);
-				return false;
-			}
+		// Limits
+		SET_IF_NOT_DEFAULT(_settings.rc_bitrate, cfg.rc_target_bitrate);
+		SET_IF_NOT_DEFAULT(_settings.rc_bitrate_overshoot, cfg.rc_overshoot_pct);
+		SET_IF_NOT_DEFAULT(_settings.rc_bitrate_undershoot, cfg.rc_undershoot_pct);
+		SET_IF_NOT_DEFAULT(_settings.rc_quantizer_min, cfg.rc_min_quantizer);
+		SET_IF_NOT_DEFAULT(_settings.rc_quantizer_max, cfg.rc_max_quantizer);
+
+		// Buffer
+		SET_IF_NOT_DEFAULT(_settings.rc_buffer_ms, cfg.rc_buf_sz);
+		SET_IF_NOT_DEFAULT(_settings.rc_buffer_initial_ms, cfg.rc_buf_initial_sz);
+		SET_IF_NOT_DEFAULT(_settings.rc_buffer_optimal_ms, cfg.rc_buf_optimal_sz);
+
+		// Key-Frames
+		SET_IF_NOT_DEFAULT(_settings.kf_mode, cfg.kf_mode);
+		SET_IF_NOT_DEFAULT(_settings.kf_distance_min, cfg.kf_min_dist);
+		SET_IF_NOT_DEFAULT(_settings.kf_distance_max, cfg.kf_max_dist);
+
+		// Holding the context lock, so this takes effect with the next frame the encoder thread hands to libaom.
+		if (auto error = _factory->libaom_codec_enc_config_set(&_ctx, &cfg); error != AOM_CODEC_OK) {
+			const char* errstr = _factory->libaom_codec_err_to_string(error);
+			const char* err    = _factory->libaom_codec_error(&_ctx);
+			const char* errdtl = _factory->libaom_codec_error_detail(&_ctx);
+			D_LOG_WARNING("Error changing configuration: %s (code %" PRIu32 ")%s%s%s%s", //
+						  (errstr ? errstr : ""), error,                                 //
+						  (err ? "\n\tMessage: " : ""), (err ? err : ""),                //
+						  (errdtl ? "\n\tDetails: " : ""), (errdtl ? errdtl : "")        //
+			);
+			return false;
 		}
+		_cfg = cfg;
 	}
 
 	if (_ctx.iface) { // Control
@@ -953,6 +1154,10 @@ void aom_av1_instance::log()
 
 	// Rate Control
 	D_LOG_INFO("  Rate Control: %s", aom_rc_mode_to_string(_settings.rc_mode));
+	if (_settings.pass != AOM_RC_ONE_PASS) {
+		D_LOG_INFO("    Pass: %s ('%s')", _settings.pass == AOM_RC_FIRST_PASS ? "First" : "Second",
+				   _settings.pass_stats.u8string().c_str());
+	}
 	D_LOG_INFO("    Look-Ahead: %" PRId8, _settings.rc_lookahead);
 	D_LOG_INFO("    Buffers: %" PRId32 " ms / %" PRId32 " ms / %" PRId32 " ms", _settings.rc_buffer_ms,
 			   _settings.rc_buffer_initial_ms, _settings.rc_buffer_optimal_ms);
@@ -967,11 +1172,16 @@ void aom_av1_instance::log()
 
 	// Advanced
 	D_LOG_INFO("  Advanced: ", "");
+	D_LOG_INFO("   Layout: %s", _settings.auto_layout ? "Automatic" : "Manual");
 	D_LOG_INFO("   Threads: %" PRId8, _settings.threads);
 	D_LOG_INFO("   Row-Multi-Threading: %s", _settings.rowmultithreading == -1  ? "Default"
 											 : _settings.rowmultithreading == 1 ? "Enabled"
 																				: "Disabled");
-	D_LOG_INFO("   Tiling: %" PRId8 "x%" PRId8, _settings.tile_columns, _settings.tile_rows);
+	D_LOG_INFO("   Tiling: %" PRId8 "x%" PRId8 " (%dx%d Tiles)", _settings.tile_columns, _settings.tile_rows,
+			   (_settings.tile_columns >= 0) ? (1 << _settings.tile_columns) : 1,
+			   (_settings.tile_rows >= 0) ? (1 << _settings.tile_rows) : 1);
+	D_LOG_INFO("   Zero-Copy: %s", _settings.zero_copy ? "Enabled" : "Disabled");
+	D_LOG_INFO("   Warm Pool: %s", _settings.warm_pool ? "Enabled" : "Disabled");
 	D_LOG_INFO("   Tune: %s (Metric), %s (Content)", aom_tune_metric_to_string(_settings.tune_metric),
 			   aom_tune_content_to_string(_settings.tune_content));
 }
@@ -1048,131 +1258,324 @@ void aom_av1_instance::get_video_info(struct video_scale_info* info)
 	}
 }
 
+bool aom_av1_instance::get_statistics(streamfx_encoder_statistics* statistics)
+{
+#ifdef ENABLE_PROFILING
+	fill_stage(statistics->copy, _profiler_copy);
+	fill_stage(statistics->encode, _profiler_encode);
+	fill_stage(statistics->packet, _profiler_packet);
+#endif
+
+	// The image ring is allocated once and never grows, so its size is also its peak.
+	for (auto& image : _images) {
+		statistics->pool_peak_bytes += image.sz;
+	}
+	return true;
+}
+
+void aom_av1_instance::request_keyframe()
+{
+	_force_keyframe.store(true, std::memory_order_release);
+}
+
+void aom_av1_instance::pooled(bool v)
+{
+	_pooled = v;
+}
+
 bool streamfx::encoder::aom::av1::aom_av1_instance::encode_video(encoder_frame* frame, encoder_packet* packet,
 																 bool* received_packet)
 {
-	// Retrieve current indexed image.
-	auto& image = _images.at(_image_index);
+	std::unique_lock<std::mutex> lock(_encode_lock);
+
+	// Wait for the encoder thread to release the next image of the ring.
+	_encode_cv.wait(lock, [this]() { return _encode_failed || (_encode_busy < _images.size()); });
+	if (_encode_failed) {
+		return false;
+	}
+	lock.unlock();
 
-	{ // Copy Image data.
+	aom_image_t* image = nullptr;
+	if (_settings.zero_copy && wrap_frame(frame)) {
+		image = &_image_wrap;
+	} else {
 #ifdef ENABLE_PROFILING
 		auto profile = _profiler_copy->track();
 #endif
-		std::memcpy(image.planes[AOM_PLANE_Y], frame->data[0], frame->linesize[0] * image.h);
-		if (image.fmt == AOM_IMG_FMT_I420) {
-			std::memcpy(image.planes[AOM_PLANE_U], frame->data[1], frame->linesize[1] * image.h / 2);
-			std::memcpy(image.planes[AOM_PLANE_V], frame->data[2], frame->linesize[2] * image.h / 2);
+		image = &_images.at(_image_index);
+
+		// OBS and libaom are free to pick different strides, so only the visible part of each row is copied.
+		std::size_t bps = (image->fmt & AOM_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+		for (std::size_t idx = AOM_PLANE_Y; idx <= AOM_PLANE_V; idx++) {
+			std::size_t shift_x = (idx != AOM_PLANE_Y) ? image->x_chroma_shift : 0;
+			std::size_t shift_y = (idx != AOM_PLANE_Y) ? image->y_chroma_shift : 0;
+			std::size_t width   = ((image->d_w + shift_x) >> shift_x) * bps;
+			std::size_t height  = (image->d_h + shift_y) >> shift_y;
+
+			::streamfx::util::plane::copy(image->planes[idx], static_cast<size_t>(image->stride[idx]),
+										  frame->data[idx], static_cast<size_t>(frame->linesize[idx]), width, height,
+										  ::streamfx::threadpool());
+		}
+	}
+
+	aom_enc_frame_flags_t flags = 0;
+	if ((_cfg.g_usage == AOM_USAGE_ALL_INTRA) || _force_keyframe.exchange(false, std::memory_order_acq_rel)) {
+		flags = AOM_EFLAG_FORCE_KF;
+	}
+
+	lock.lock();
+
+	// Hand the image to the encoder thread.
+	_encode_input.push_back({image, frame->pts, flags});
+	_encode_start.emplace(frame->pts, std::chrono::high_resolution_clock::now());
+	_encode_lag = std::max(_encode_lag, _encode_start.size());
+	if (image == &_image_wrap) {
+		// OBS only keeps the frame valid until we return, so wait for libaom to take its copy.
+		_encode_wrapped = true;
+		_encode_cv.notify_all();
+		_encode_cv.wait(lock, [this]() { return _encode_failed || !_encode_wrapped; });
+	} else {
+		_encode_busy++;
+		_image_index = (_image_index + 1) % _images.size();
+	}
+
+	// Hand out the oldest finished packet, if there is one. It must stay valid until the next call.
+	if (_encode_current) {
+		_encode_pool.push_back(std::move(_encode_current));
+	}
+	if (!_encode_output.empty()) {
+		_encode_current = std::move(_encode_output.front());
+		_encode_output.pop_front();
+	}
+
+	lock.unlock();
+	_encode_cv.notify_all();
+
+	if (_encode_current) {
+		// Status
+		packet->type     = OBS_ENCODER_VIDEO;
+		packet->keyframe = ((_encode_current->flags & AOM_FRAME_IS_KEY) == AOM_FRAME_IS_KEY)
+						   || (_cfg.g_usage == AOM_USAGE_ALL_INTRA);
+		if (packet->keyframe) {
+			//
+			packet->priority      = 3; // OBS_NAL_PRIORITY_HIGHEST
+			packet->drop_priority = 3; // OBS_NAL_PRIORITY_HIGHEST
+		} else if ((_encode_current->flags & AOM_FRAME_IS_DROPPABLE) != AOM_FRAME_IS_DROPPABLE) {
+			// Dropping this frame breaks the bitstream.
+			packet->priority      = 2; // OBS_NAL_PRIORITY_HIGH
+			packet->drop_priority = 3; // OBS_NAL_PRIORITY_HIGHEST
 		} else {
-			std::memcpy(image.planes[AOM_PLANE_U], frame->data[1], frame->linesize[1] * image.h);
-			std::memcpy(image.planes[AOM_PLANE_V], frame->data[2], frame->linesize[2] * image.h);
+			// This frame can be dropped at will.
+			packet->priority      = 0; // OBS_NAL_PRIORITY_DISPOSABLE
+			packet->drop_priority = 0; // OBS_NAL_PRIORITY_DISPOSABLE
+		}
+
+		// Data
+		packet->data = _encode_current->data.data();
+		packet->size = _encode_current->data.size();
+
+		// Timestamps
+		packet->pts = _encode_current->pts;
+		packet->dts = _encode_current->dts;
+
+		*received_packet = true;
+#ifdef _DEBUG
+		D_LOG_DEBUG("Packet: Type=%s PTS=%06" PRId64 " DTS=%06" PRId64 " Size=%016" PRIuPTR "",
+					packet->keyframe ? "I" : "P", packet->pts, packet->dts, packet->size);
+#endif
+	} else {
+		packet->type = OBS_ENCODER_VIDEO;
+		packet->data = nullptr;
+		packet->size = 0;
+		packet->pts  = -1;
+		packet->dts  = -1;
+#ifdef _DEBUG
+		D_LOG_DEBUG("No Packet", "");
+#endif
+	}
+
+	return true;
+}
+
+bool aom_av1_instance::wrap_frame(encoder_frame* frame)
+{
+	// Rows have to be laid out like in our own images, anything unusual takes the copy path instead.
+	std::size_t bps = (_image_wrap.fmt & AOM_IMG_FMT_HIGHBITDEPTH) ? 2 : 1;
+	for (std::size_t idx = AOM_PLANE_Y; idx <= AOM_PLANE_V; idx++) {
+		std::size_t shift_x = (idx != AOM_PLANE_Y) ? _image_wrap.x_chroma_shift : 0;
+		std::size_t width   = ((_image_wrap.d_w + shift_x) >> shift_x) * bps;
+
+		if (!frame->data[idx] || (frame->linesize[idx] < width)
+			|| ((reinterpret_cast<uintptr_t>(frame->data[idx]) % ST_IMAGE_ALIGN) != 0)
+			|| ((frame->linesize[idx] % ST_IMAGE_ALIGN) != 0)) {
+			return false;
 		}
 	}
 
-	{ // Try to encode the new image.
+	for (std::size_t idx = AOM_PLANE_Y; idx <= AOM_PLANE_V; idx++) {
+		_image_wrap.planes[idx] = frame->data[idx];
+		_image_wrap.stride[idx] = static_cast<int>(frame->linesize[idx]);
+	}
+	return true;
+}
+
+void aom_av1_instance::encode_main()
+{
+	std::unique_lock<std::mutex> lock(_encode_lock);
+	for (;;) {
+		_encode_cv.wait(lock, [this]() { return _encode_stop || !_encode_input.empty(); });
+		if (_encode_stop) {
+			// The first pass has to see every frame it was given, or its statistics are incomplete.
+			if ((_settings.pass != AOM_RC_FIRST_PASS) || _encode_failed || _encode_input.empty()) {
+				break;
+			}
+		}
+
+		auto input = _encode_input.front();
+		_encode_input.pop_front();
+		lock.unlock();
+
+		bool failed = false;
+		{
+			std::unique_lock<std::mutex> context_lock(_context_lock);
+
+			{ // Try to encode the new image.
 #ifdef ENABLE_PROFILING
-		auto profile = _profiler_encode->track();
+				auto profile = _profiler_encode->track();
 #endif
-		aom_enc_frame_flags_t flags = 0;
-		if (_cfg.g_usage == AOM_USAGE_ALL_INTRA) {
-			flags = AOM_EFLAG_FORCE_KF;
+				if (auto error = _factory->libaom_codec_encode(&_ctx, input.image, input.pts, 1, input.flags);
+					error != AOM_CODEC_OK) {
+					const char* errstr = _factory->libaom_codec_err_to_string(error);
+					D_LOG_ERROR("Encoding frame failed with error: %s (code %" PRIu32 ")\n%s\n%s", errstr, error,
+								_factory->libaom_codec_error(&_ctx), _factory->libaom_codec_error_detail(&_ctx));
+					failed = true;
+				}
+			}
+
+			if (!failed) {
+				encode_drain();
+			}
 		}
-		if (auto error = _factory->libaom_codec_encode(&_ctx, &image, frame->pts, 1, flags); error != AOM_CODEC_OK) {
-			const char* errstr = _factory->libaom_codec_err_to_string(error);
-			D_LOG_ERROR("Encoding frame failed with error: %s (code %" PRIu32 ")\n%s\n%s", errstr, error,
-						_factory->libaom_codec_error(&_ctx), _factory->libaom_codec_error_detail(&_ctx));
-			return false;
+
+		// libaom copies the image into its look-ahead buffer, so it is free for reuse.
+		lock.lock();
+		if (input.image == &_image_wrap) {
+			_encode_wrapped = false;
 		} else {
-			// Increment the image index.
-			_image_index = (_image_index++) % _images.size();
+			_encode_busy--;
 		}
+		if (failed) {
+			_encode_failed = true;
+		}
+		_encode_cv.notify_all();
 	}
+}
 
-	{ // Get Packet
+std::size_t aom_av1_instance::encode_drain()
+{
 #ifdef ENABLE_PROFILING
-		auto profile = _profiler_packet->track();
+	auto profile = _profiler_packet->track();
 #endif
-		aom_codec_iter_t iter = NULL;
-		for (auto* pkt = _factory->libaom_codec_get_cx_data(&_ctx, &iter); pkt != nullptr;
-			 pkt       = _factory->libaom_codec_get_cx_data(&_ctx, &iter)) {
+
+	std::size_t      packets = 0;
+	aom_codec_iter_t iter    = NULL;
+	for (auto* pkt = _factory->libaom_codec_get_cx_data(&_ctx, &iter); pkt != nullptr;
+		 pkt       = _factory->libaom_codec_get_cx_data(&_ctx, &iter), packets++) {
 #ifdef _DEBUG
-			{
-				const char* kind = "";
-				switch (pkt->kind) {
-				case AOM_CODEC_CX_FRAME_PKT:
-					kind = "Frame";
-					break;
-				case AOM_CODEC_STATS_PKT:
-					kind = "Stats";
-					break;
-				case AOM_CODEC_FPMB_STATS_PKT:
-					kind = "FPMB Stats";
-					break;
-				case AOM_CODEC_PSNR_PKT:
-					kind = "PSNR";
-					break;
-				case AOM_CODEC_CUSTOM_PKT:
-					kind = "Custom";
-					break;
-				}
-				D_LOG_DEBUG("\tPacket: Kind=%s", kind)
+		{
+			const char* kind = "";
+			switch (pkt->kind) {
+			case AOM_CODEC_CX_FRAME_PKT:
+				kind = "Frame";
+				break;
+			case AOM_CODEC_STATS_PKT:
+				kind = "Stats";
+				break;
+			case AOM_CODEC_FPMB_STATS_PKT:
+				kind = "FPMB Stats";
+				break;
+			case AOM_CODEC_PSNR_PKT:
+				kind = "PSNR";
+				break;
+			case AOM_CODEC_CUSTOM_PKT:
+				kind = "Custom";
+				break;
 			}
+			D_LOG_DEBUG("\tPacket: Kind=%s", kind)
+		}
 #endif
 
-			if (pkt->kind == AOM_CODEC_CX_FRAME_PKT) {
-				// Status
-				packet->type     = OBS_ENCODER_VIDEO;
-				packet->keyframe = ((pkt->data.frame.flags & AOM_FRAME_IS_KEY) == AOM_FRAME_IS_KEY)
-								   || (_cfg.g_usage == AOM_USAGE_ALL_INTRA);
-				if (packet->keyframe) {
-					//
-					packet->priority      = 3; // OBS_NAL_PRIORITY_HIGHEST
-					packet->drop_priority = 3; // OBS_NAL_PRIORITY_HIGHEST
-				} else if ((pkt->data.frame.flags & AOM_FRAME_IS_DROPPABLE) != AOM_FRAME_IS_DROPPABLE) {
-					// Dropping this frame breaks the bitstream.
-					packet->priority      = 2; // OBS_NAL_PRIORITY_HIGH
-					packet->drop_priority = 3; // OBS_NAL_PRIORITY_HIGHEST
-				} else {
-					// This frame can be dropped at will.
-					packet->priority      = 0; // OBS_NAL_PRIORITY_DISPOSABLE
-					packet->drop_priority = 0; // OBS_NAL_PRIORITY_DISPOSABLE
-				}
-
-				// Data
-				packet->data = static_cast<uint8_t*>(pkt->data.frame.buf);
-				packet->size = pkt->data.frame.sz;
+		if (pkt->kind == AOM_CODEC_STATS_PKT) {
+			if (_stats_out) {
+				_stats_out.write(static_cast<const char*>(pkt->data.twopass_stats.buf),
+								 static_cast<std::streamsize>(pkt->data.twopass_stats.sz));
+			}
+			continue;
+		} else if (pkt->kind != AOM_CODEC_CX_FRAME_PKT) {
+			continue;
+		}
 
-				// Timestamps
-				//TODO: Temporarily set both to the same until there is a way to figure out actual order.
-				packet->pts = pkt->data.frame.pts;
-				packet->dts = pkt->data.frame.pts;
+		std::unique_ptr<encode_output> output;
+		{
+			std::unique_lock<std::mutex> lock(_encode_lock);
+			if (!_encode_pool.empty()) {
+				output = std::move(_encode_pool.back());
+				_encode_pool.pop_back();
+			}
+		}
+		if (!output) {
+			output = std::make_unique<encode_output>();
+		}
 
-				*received_packet = true;
+		// libaom reuses its buffer on the next call, so the data is copied into memory we own.
+		auto* data = static_cast<const uint8_t*>(pkt->data.frame.buf);
+		output->data.assign(data, data + pkt->data.frame.sz);
+		output->pts   = pkt->data.frame.pts;
+		output->flags = pkt->data.frame.flags;
+
+		{ // Decode Timestamp
+			// libaom emits whole temporal units in presentation order, hidden alt-ref frames travel inside the unit of
+			// the next shown frame, so packets stay within the reorder depth derived from the configuration. Should a
+			// packet ever arrive further behind, all following packets are decoded that many frames ahead.
+			if (_encode_pts != std::numeric_limits<int64_t>::min()) {
+				if (output->pts > _encode_pts) {
+					// The smallest distance between packets is the duration of a frame.
+					int64_t step = output->pts - _encode_pts;
+					_encode_step = (_encode_step > 0) ? std::min(_encode_step, step) : step;
+				} else if (_encode_step > 0) {
+					int64_t behind = _encode_pts - output->pts;
+					auto    depth  = static_cast<std::size_t>((behind + _encode_step - 1) / _encode_step);
+					if (depth > _encode_reorder) {
+						D_LOG_WARNING("Packets are reordered by %" PRIuPTR " frames, delaying decode timestamps.",
+									  depth);
+						_encode_reorder = depth;
+					}
+				}
 			}
+			_encode_pts = std::max(_encode_pts, output->pts);
 
-			if (*received_packet == true)
-				break;
+			// Muxers reject decode timestamps that do not strictly increase, or that lie after the presentation
+			// timestamp. A packet beyond the reorder depth can't satisfy both, it keeps its presentation timestamp.
+			output->dts = output->pts - static_cast<int64_t>(_encode_reorder) * std::max<int64_t>(_encode_step, 1);
+			if ((_encode_dts != std::numeric_limits<int64_t>::min()) && (output->dts <= _encode_dts)) {
+				output->dts = std::min(_encode_dts + 1, output->pts);
+			}
+			_encode_dts = std::max(_encode_dts, output->dts);
 		}
 
-		if (!*received_packet) {
-			packet->type = OBS_ENCODER_VIDEO;
-			packet->data = nullptr;
-			packet->size = 0;
-			packet->pts  = -1;
-			packet->dts  = -1;
-#ifdef _DEBUG
-			D_LOG_DEBUG("No Packet", "");
-#endif
-			// Not necessarily an error.
-			//return false;
-		} else {
-#ifdef _DEBUG
-			D_LOG_DEBUG("Packet: Type=%s PTS=%06" PRId64 " DTS=%06" PRId64 " Size=%016" PRIuPTR "",
-						packet->keyframe ? "I" : "P", packet->pts, packet->dts, packet->size);
+		std::unique_lock<std::mutex> lock(_encode_lock);
+		if (auto kv = _encode_start.find(output->pts); kv != _encode_start.end()) {
+#ifdef ENABLE_PROFILING
+			auto lag = std::chrono::high_resolution_clock::now() - kv->second;
+			_profiler_lag->track(std::chrono::duration_cast<std::chrono::nanoseconds>(lag));
 #endif
+			// Anything older than this was dropped by the encoder.
+			_encode_start.erase(_encode_start.begin(), std::next(kv));
 		}
+		_encode_output.push_back(std::move(output));
 	}
 
-	return true;
+	return packets;
 }
 
 aom_av1_factory::aom_av1_factory()
@@ -1282,6 +1685,10 @@ try {
 
 void aom_av1_factory::finalize()
 {
+	// Warm instances hold on to the factory, so they have to go first.
+	if (_aom_av1_factory_instance) {
+		_aom_av1_factory_instance->warm_discard();
+	}
 	_aom_av1_factory_instance.reset();
 }
 
@@ -1297,9 +1704,238 @@ const char* aom_av1_factory::get_name()
 
 void* aom_av1_factory::create(obs_data_t* settings, obs_encoder_t* encoder, bool is_hw)
 {
+	if (auto instance = warm_claim(settings, encoder); instance) {
+		return instance.release();
+	}
 	return new aom_av1_instance(settings, encoder, is_hw);
 }
 
+// Everything a warm instance depends on, or an empty key if the encoder can't be warmed up.
+static std::string aom_warm_key(obs_data_t* settings, obs_encoder_t* encoder)
+{
+	if (!streamfx::util::is_tristate_enabled(obs_data_get_int(settings, ST_KEY_ADVANCED_WARMPOOL))) {
+		return {};
+	}
+
+	// Multi-pass encodes open their statistics when initialized, which must only happen for a real encode.
+	if (obs_data_get_int(settings, ST_KEY_ENCODER_PASS) != AOM_RC_ONE_PASS) {
+		return {};
+	}
+
+	video_t* video = obs_encoder_video(encoder);
+	if (!video) {
+		return {};
+	}
+	const struct video_output_info* info = video_output_get_info(video);
+
+	std::string key;
+	key += std::to_string(obs_encoder_get_width(encoder)) + "x" + std::to_string(obs_encoder_get_height(encoder));
+	key += "@" + std::to_string(info->fps_num) + "/" + std::to_string(info->fps_den);
+	key += "|" + std::to_string(static_cast<int>(info->format)) + "|"
+		   + std::to_string(static_cast<int>(obs_encoder_get_preferred_video_format(encoder)));
+	key += "|" + std::to_string(static_cast<int>(info->colorspace)) + "|"
+		   + std::to_string(static_cast<int>(info->range));
+	key += "|" + std::string(obs_data_get_json(settings));
+	return key;
+}
+
+aom_av1_factory::warm_instance::warm_instance(obs_encoder_t* encoder)
+	: weak(obs_encoder_get_weak_encoder(encoder)), started(false), task(), key(), instance()
+{}
+
+aom_av1_factory::warm_instance::~warm_instance()
+{
+	instance.reset();
+	obs_weak_encoder_release(weak);
+}
+
+void aom_av1_factory::warm(obs_encoder_t* encoder)
+{
+	auto pool = ::streamfx::threadpool();
+	if (!pool) {
+		return;
+	}
+
+	warm_sweep();
+
+	// An encoder that is being destroyed can no longer be resolved, and will never start again.
+	auto entry = std::make_shared<warm_instance>(encoder);
+	if (obs_encoder_t* strong = obs_weak_encoder_get_encoder(entry->weak); strong) {
+		obs_data_t* settings = obs_encoder_get_settings(strong);
+		entry->key           = aom_warm_key(settings, strong);
+		obs_data_release(settings);
+		obs_encoder_release(strong);
+	}
+	if (entry->key.empty()) {
+		entry.reset();
+	}
+
+	// The task only holds a weak reference, as the entry holds the task.
+	if (entry) {
+		entry->task = pool->push(
+			[this, weak = std::weak_ptr<warm_instance>(entry)](streamfx::util::threadpool_data_t) {
+				if (auto entry = weak.lock(); entry) {
+					warm_main(entry);
+				}
+			},
+			nullptr, streamfx::util::threadpool::priority::BACKGROUND);
+	}
+
+	std::shared_ptr<warm_instance> previous;
+	{
+		std::unique_lock<std::mutex> lock(_warm_lock);
+		if (auto found = _warm.find(encoder); found != _warm.end()) {
+			previous = std::move(found->second);
+			_warm.erase(found);
+		}
+		if (entry) {
+			_warm.emplace(encoder, entry);
+		}
+	}
+	if (previous) {
+		warm_finish(previous);
+	}
+}
+
+void aom_av1_factory::warm_discard(obs_encoder_t* encoder)
+{
+	std::vector<std::shared_ptr<warm_instance>> entries;
+	{
+		std::unique_lock<std::mutex> lock(_warm_lock);
+		for (auto itr = _warm.begin(); itr != _warm.end();) {
+			if (!encoder || (itr->first == encoder)) {
+				entries.push_back(std::move(itr->second));
+				itr = _warm.erase(itr);
+			} else {
+				++itr;
+			}
+		}
+	}
+
+	// Destroyed outside of the lock, as tearing down libaom takes a moment.
+	for (auto& entry : entries) {
+		warm_finish(entry);
+	}
+}
+
+void aom_av1_factory::warm_sweep()
+{
+	std::vector<std::pair<obs_encoder_t*, std::shared_ptr<warm_instance>>> entries;
+	{
+		std::unique_lock<std::mutex> lock(_warm_lock);
+		entries.assign(_warm.begin(), _warm.end());
+	}
+
+	// Encoders that were destroyed never claim their entry, and their address may be reused by a new encoder. The
+	// references are resolved outside of the lock, as releasing the last one destroys the encoder.
+	std::vector<std::shared_ptr<warm_instance>> stale;
+	for (auto& kv : entries) {
+		obs_encoder_t* encoder = obs_weak_encoder_get_encoder(kv.second->weak);
+		if (encoder != kv.first) {
+			stale.push_back(kv.second);
+		}
+		obs_encoder_release(encoder);
+	}
+	if (stale.empty()) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(_warm_lock);
+		for (auto& entry : stale) {
+			for (auto itr = _warm.begin(); itr != _warm.end(); ++itr) {
+				if (itr->second == entry) {
+					_warm.erase(itr);
+					break;
+				}
+			}
+		}
+	}
+	for (auto& entry : stale) {
+		warm_finish(entry);
+	}
+}
+
+std::unique_ptr<aom_av1_instance> aom_av1_factory::warm_claim(obs_data_t* settings, obs_encoder_t* encoder)
+{
+	warm_sweep();
+
+	std::shared_ptr<warm_instance> entry;
+	{
+		std::unique_lock<std::mutex> lock(_warm_lock);
+		if (auto found = _warm.find(encoder); found != _warm.end()) {
+			entry = std::move(found->second);
+			_warm.erase(found);
+		}
+	}
+	if (!entry) {
+		return nullptr;
+	}
+
+	// Settings, resolution or format may have changed since the warm-up was queued. A running warm-up is left to
+	// finish on its own, it only holds a weak reference and tears itself down afterwards.
+	if (entry->key != aom_warm_key(settings, encoder)) {
+		D_LOG_INFO("Discarding warm encoder, as its settings no longer match.");
+		if (!entry->started.exchange(true)) {
+			::streamfx::threadpool()->pop(entry->task);
+		}
+		return nullptr;
+	}
+
+	// If the warm-up is already running, finishing it is still faster than starting over.
+	warm_finish(entry);
+	if (!entry->instance) {
+		return nullptr;
+	}
+
+	D_LOG_INFO("Using warm encoder initialized in the background.");
+	entry->instance->pooled(false);
+	return std::move(entry->instance);
+}
+
+void aom_av1_factory::warm_main(std::shared_ptr<warm_instance> entry)
+try {
+	if (entry->started.exchange(true)) {
+		return;
+	}
+
+	// The encoder may have been destroyed in the mean time, in which case there is nothing to warm up for.
+	obs_encoder_t* encoder = obs_weak_encoder_get_encoder(entry->weak);
+	if (!encoder) {
+		return;
+	}
+	obs_data_t* settings = obs_encoder_get_settings(encoder);
+
+	try {
+		// Only initialize what the entry was queued for, a newer call to warm() covers anything else.
+		if (aom_warm_key(settings, encoder) == entry->key) {
+			auto instance = std::make_unique<aom_av1_instance>(settings, encoder, false);
+			instance->pooled(true);
+			entry->instance = std::move(instance);
+		}
+	} catch (...) {
+		obs_data_release(settings);
+		obs_encoder_release(encoder);
+		throw;
+	}
+	obs_data_release(settings);
+	obs_encoder_release(encoder);
+} catch (const std::exception& ex) {
+	D_LOG_WARNING("Failed to warm up encoder: %s", ex.what());
+} catch (...) {
+	D_LOG_WARNING("Failed to warm up encoder.");
+}
+
+void aom_av1_factory::warm_finish(const std::shared_ptr<warm_instance>& entry)
+{
+	if (!entry->started.exchange(true)) {
+		// Never started, so it never will.
+		::streamfx::threadpool()->pop(entry->task);
+	} else {
+		entry->task->await_completion();
+	}
+}
+
 void aom_av1_factory::get_defaults2(obs_data_t* settings)
 {
 	{ // Presets
@@ -1307,6 +1943,8 @@ void aom_av1_factory::get_defaults2(obs_data_t* settings)
 		obs_data_set_default_int(settings, ST_KEY_ENCODER_CPUUSAGE, -1);
 		obs_data_set_default_int(settings, ST_KEY_ENCODER_PROFILE,
 								 static_cast<long long>(codec::av1::profile::UNKNOWN));
+		obs_data_set_default_int(settings, ST_KEY_ENCODER_PASS, static_cast<long long>(AOM_RC_ONE_PASS));
+		obs_data_set_default_string(settings, ST_KEY_ENCODER_PASS_STATISTICS, "");
 	}
 
 	{ // Rate-Control
@@ -1335,6 +1973,8 @@ void aom_av1_factory::get_defaults2(obs_data_t* settings)
 	{ // Advanced Options
 		obs_data_set_default_int(settings, ST_KEY_ADVANCED_THREADS, 0);
 		obs_data_set_default_int(settings, ST_KEY_ADVANCED_ROWMULTITHREADING, -1);
+		obs_data_set_default_int(settings, ST_KEY_ADVANCED_ZEROCOPY, -1);
+		obs_data_set_default_int(settings, ST_KEY_ADVANCED_WARMPOOL, -1);
 		obs_data_set_default_int(settings, ST_KEY_ADVANCED_TILE_COLUMNS, -1);
 		obs_data_set_default_int(settings, ST_KEY_ADVANCED_TILE_ROWS, -1);
 		obs_data_set_default_int(settings, ST_KEY_ADVANCED_TUNE_METRIC, -1);
@@ -1362,6 +2002,19 @@ try {
 	return false;
 }
 
+static bool modified_pass(obs_properties_t* props, obs_property_t*, obs_data_t* settings) noexcept
+try {
+	bool is_multipass = obs_data_get_int(settings, ST_KEY_ENCODER_PASS) != AOM_RC_ONE_PASS;
+	obs_property_set_visible(obs_properties_get(props, ST_KEY_ENCODER_PASS_STATISTICS), is_multipass);
+	return true;
+} catch (const std::exception& ex) {
+	DLOG_ERROR("Unexpected exception in function '%s': %s.", __FUNCTION_NAME__, ex.what());
+	return false;
+} catch (...) {
+	DLOG_ERROR("Unexpected exception in function '%s'.", __FUNCTION_NAME__);
+	return false;
+}
+
 static bool modified_ratecontrol_mode(obs_properties_t* props, obs_property_t*, obs_data_t* settings) noexcept
 try {
 	bool is_bitrate_visible        = false;
@@ -1480,6 +2133,22 @@ obs_properties_t* aom_av1_factory::get_properties2(instance_t* data)
 			obs_property_list_add_int(p, codec::av1::profile_to_string(codec::av1::profile::PROFESSIONAL),
 									  static_cast<long long>(codec::av1::profile::PROFESSIONAL));
 		}
+
+		{ // Multi-Pass
+			auto p = obs_properties_add_list(grp, ST_KEY_ENCODER_PASS, D_TRANSLATE(ST_I18N_ENCODER_PASS),
+											 OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+			obs_property_set_long_description(p, D_TRANSLATE(ST_I18N_ENCODER_PASS_DESCRIPTION));
+			obs_property_set_modified_callback(p, modified_pass);
+			obs_property_list_add_int(p, D_TRANSLATE(ST_I18N_ENCODER_PASS_SINGLE),
+									  static_cast<long long>(AOM_RC_ONE_PASS));
+			obs_property_list_add_int(p, D_TRANSLATE(ST_I18N_ENCODER_PASS_FIRST),
+									  static_cast<long long>(AOM_RC_FIRST_PASS));
+			obs_property_list_add_int(p, D_TRANSLATE(ST_I18N_ENCODER_PASS_SECOND),
+									  static_cast<long long>(AOM_RC_SECOND_PASS));
+
+			obs_properties_add_path(grp, ST_KEY_ENCODER_PASS_STATISTICS, D_TRANSLATE(ST_I18N_ENCODER_PASS_STATISTICS),
+									OBS_PATH_FILE_SAVE, "* (*.*)", nullptr);
+		}
 	}
 
 	{ // Rate Control Options
@@ -1608,6 +2277,16 @@ obs_properties_t* aom_av1_factory::get_properties2(instance_t* data)
 											std::numeric_limits<int32_t>::max(), 1);
 		}
 
+		{ // Zero-Copy
+			auto p = streamfx::util::obs_properties_add_tristate(grp, ST_KEY_ADVANCED_ZEROCOPY,
+																 D_TRANSLATE(ST_I18N_ADVANCED_ZEROCOPY));
+		}
+
+		{ // Warm Pool
+			auto p = streamfx::util::obs_properties_add_tristate(grp, ST_KEY_ADVANCED_WARMPOOL,
+																 D_TRANSLATE(ST_I18N_ADVANCED_WARMPOOL));
+		}
+
 #ifdef AOM_CTRL_AV1E_SET_ROW_MT
 		{ // Row-MT
 			auto p = streamfx::util::obs_properties_add_tristate(grp, ST_KEY_ADVANCED_ROWMULTITHREADING,
@@ -20,12 +20,23 @@
 
 #pragma once
 #include "common.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include "encoders/codecs/av1.hpp"
 #include "obs/obs-encoder-factory.hpp"
 #include "util/util-library.hpp"
+#include "util/util-platform.hpp"
 #include "util/util-profiler.hpp"
+#include "util/util-threadpool.hpp"
 
 #include <aom/aomcx.h>
 
@@ -33,6 +44,19 @@ namespace streamfx::encoder::aom::av1 {
 	class aom_av1_factory;
 
 	class aom_av1_instance : public obs::encoder_instance {
+		struct encode_input {
+			aom_image_t*          image;
+			int64_t               pts;
+			aom_enc_frame_flags_t flags;
+		};
+
+		struct encode_output {
+			std::vector<uint8_t>    data;
+			int64_t                 pts;
+			int64_t                 dts;
+			aom_codec_frame_flags_t flags;
+		};
+
 		std::shared_ptr<aom_av1_factory> _factory;
 
 		aom_codec_iface_t*       _iface;
@@ -40,9 +64,11 @@ namespace streamfx::encoder::aom::av1 {
 		aom_codec_enc_cfg_t      _cfg;
 		size_t                   _image_index;
 		std::vector<aom_image_t> _images;
+		aom_image_t              _image_wrap;
 		aom_fixed_buf_t*         _global_headers;
 
 		bool _initialized;
+		bool _pooled;
 		struct {
 			// Video (All Static)
 			uint16_t width;
@@ -64,6 +90,10 @@ namespace streamfx::encoder::aom::av1 {
 			codec::av1::profile profile; // Static
 			int8_t              preset;
 
+			// Multi-Pass (All Static)
+			aom_enc_pass          pass;
+			std::filesystem::path pass_stats;
+
 			// Rate Control
 			aom_rc_mode rc_mode;      // Static
 			int8_t      rc_lookahead; // Static
@@ -87,14 +117,51 @@ namespace streamfx::encoder::aom::av1 {
 			int8_t           rowmultithreading;
 			int8_t           tile_columns;
 			int8_t           tile_rows;
+			bool             auto_layout;
 			aom_tune_metric  tune_metric;
 			aom_tune_content tune_content;
+
+			// Input (Static)
+			bool zero_copy;
+
+			// Warm Pool (Static)
+			bool warm_pool;
 		} _settings;
 
+		// Key frame requested while encoding, applied to the next frame.
+		std::atomic<bool> _force_keyframe;
+
+		// Encoder Thread, owns the codec context once started.
+		std::thread                                                       _encode_thread;
+		std::mutex                                                        _encode_lock;
+		std::condition_variable                                           _encode_cv;
+		bool                                                              _encode_stop;
+		bool                                                              _encode_failed;
+		std::size_t                                                       _encode_busy;
+		bool                                                              _encode_wrapped;
+		std::deque<encode_input>                                          _encode_input;
+		std::deque<std::unique_ptr<encode_output>>                        _encode_output;
+		std::unique_ptr<encode_output>                                    _encode_current;
+		std::vector<std::unique_ptr<encode_output>>                       _encode_pool;
+		std::map<int64_t, std::chrono::high_resolution_clock::time_point> _encode_start;
+		std::size_t                                                       _encode_lag;
+		std::mutex                                                        _context_lock;
+
+		// Decode order, only touched by the encoder thread.
+		int64_t     _encode_pts;
+		int64_t     _encode_dts;
+		int64_t     _encode_step;
+		std::size_t _encode_reorder;
+
+		// First-pass statistics, written by the first pass and read back by the second.
+		std::ofstream                                          _stats_out;
+		std::unique_ptr<streamfx::util::platform::mapped_file> _stats_in;
+
 #ifdef ENABLE_PROFILING
 		std::shared_ptr<streamfx::util::profiler> _profiler_copy;
 		std::shared_ptr<streamfx::util::profiler> _profiler_encode;
 		std::shared_ptr<streamfx::util::profiler> _profiler_packet;
+		std::shared_ptr<streamfx::util::profiler> _profiler_lag;
 #endif
 
 		public:
@@ -105,6 +172,20 @@ namespace streamfx::encoder::aom::av1 {
 
 		virtual bool update(obs_data_t* settings);
 
+		virtual void request_keyframe();
+
+		/** Mark the instance as sitting in the warm pool, where its destruction must not warm up another one. */
+		void pooled(bool v);
+
+		private:
+		bool wrap_frame(encoder_frame* frame);
+
+		void encode_main();
+
+		std::size_t encode_drain();
+
+		public:
+
 		void log();
 
 		virtual bool get_extra_data(uint8_t** extra_data, size_t* size);
@@ -113,12 +194,29 @@ namespace streamfx::encoder::aom::av1 {
 
 		virtual void get_video_info(struct video_scale_info* info);
 
+		virtual bool get_statistics(streamfx_encoder_statistics* statistics);
+
 		virtual bool encode_video(encoder_frame* frame, encoder_packet* packet, bool* received_packet);
 	};
 
 	class aom_av1_factory : public obs::encoder_factory<aom_av1_factory, aom_av1_instance> {
+		// An instance initialized in the background for the next start of an encoder.
+		struct warm_instance {
+			obs_weak_encoder_t*                                 weak;
+			std::atomic<bool>                                   started;
+			std::shared_ptr<::streamfx::util::threadpool::task> task;
+			std::string                                         key;
+			std::unique_ptr<aom_av1_instance>                   instance;
+
+			warm_instance(obs_encoder_t* encoder);
+			~warm_instance();
+		};
+
 		std::shared_ptr<::streamfx::util::library> _library;
 
+		std::mutex                                               _warm_lock;
+		std::map<obs_encoder_t*, std::shared_ptr<warm_instance>> _warm;
+
 		public:
 		aom_av1_factory();
 		~aom_av1_factory();
@@ -127,6 +225,24 @@ namespace streamfx::encoder::aom::av1 {
 
 		void* create(obs_data_t* settings, obs_encoder_t* encoder, bool is_hw) override;
 
+		/** Initialize an instance for the encoder's current settings in the background, so its next start is fast. */
+		void warm(obs_encoder_t* encoder);
+
+		/** Discard warm instances of the given encoder, or of all encoders if nullptr. */
+		void warm_discard(obs_encoder_t* encoder = nullptr);
+
+		private:
+		/** Discard warm instances of encoders that no longer exist. */
+		void warm_sweep();
+
+		std::unique_ptr<aom_av1_instance> warm_claim(obs_data_t* settings, obs_encoder_t* encoder);
+
+		void warm_main(std::shared_ptr<warm_instance> entry);
+
+		static void warm_finish(const std::shared_ptr<warm_instance>& entry);
+
+		public:
+
 		void get_defaults2(obs_data_t* data) override;
 
 		obs_properties_t* get_properties2(instance_t* data) override;
@@ -22,11 +22,15 @@
 #include "encoder-ffmpeg.hpp"
 #include "strings.hpp"
 #include <sstream>
+#include "codecs/av1.hpp"
+#include "codecs/h264.hpp"
 #include "codecs/hevc.hpp"
 #include "ffmpeg/tools.hpp"
 #include "handlers/debug_handler.hpp"
 #include "obs/gs/gs-helper.hpp"
+#include "configuration.hpp"
 #include "plugin.hpp"
+#include "util/util-plane.hpp"
 
 #ifdef ENABLE_ENCODER_FFMPEG_AMF
 #include "handlers/amf_h264_handler.hpp"
@@ -49,6 +53,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/dict.h>
 #include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
 #pragma warning(pop)
@@ -67,6 +72,8 @@ extern "C" {
 #define ST_KEY_FFMPEG_THREADS "FFmpeg.Threads"
 #define ST_I18N_FFMPEG_GPU ST_I18N_FFMPEG ".GPU"
 #define ST_KEY_FFMPEG_GPU "FFmpeg.GPU"
+#define ST_I18N_FFMPEG_CONVERSIONTHREADS ST_I18N_FFMPEG ".ConversionThreads"
+#define ST_KEY_FFMPEG_CONVERSIONTHREADS "FFmpeg.ConversionThreads"
 
 #define ST_I18N_KEYFRAMES ST_I18N_FFMPEG ".KeyFrames"
 #define ST_I18N_KEYFRAMES_INTERVALTYPE ST_I18N_KEYFRAMES ".IntervalType"
@@ -76,6 +83,30 @@ extern "C" {
 #define ST_KEY_KEYFRAMES_INTERVAL_SECONDS "KeyFrames.Interval.Seconds"
 #define ST_KEY_KEYFRAMES_INTERVAL_FRAMES "KeyFrames.Interval.Frames"
 
+// Maximum number of frames kept around for reuse.
+#define ST_FRAME_POOL_SIZE 32
+
+// How often idle frames beyond what the encoder recently needed are released, in milliseconds. 0 disables trimming.
+#define ST_CFG_FRAME_POOL_TRIM_INTERVAL "encoder.ffmpeg.frame_pool.trim_interval"
+#define ST_FRAME_POOL_TRIM_INTERVAL 5000
+
+// Frames waiting for and packets coming from the encoder thread.
+#define ST_ENCODE_QUEUE_INPUT 4
+#define ST_ENCODE_QUEUE_OUTPUT 16
+#define ST_ENCODE_LATENCY_TRACKED 256
+
+// Packets kept around for reuse, enough for a full output queue plus the one handed to OBS.
+#define ST_PACKET_POOL_SIZE (ST_ENCODE_QUEUE_OUTPUT + 2)
+
+// Required alignment of OBS's planes to be passed to encoders directly.
+#define ST_ZERO_COPY_ALIGNMENT 32
+
+// Encoders that copy software frames into buffers of their own before avcodec_send_frame returns, however long they
+// delay their output. Encoders that keep a reference instead would never let go of OBS's memory until the next frame.
+static const std::set<std::string_view> zero_copy_encoders = {
+	"libx264", "libx265", "libvpx", "libvpx-vp9", "libaom-av1", "libsvtav1", "h264_nvenc", "hevc_nvenc",
+};
+
 using namespace streamfx::encoder::ffmpeg;
 using namespace streamfx::encoder::codec;
 
@@ -88,14 +119,42 @@ ffmpeg_instance::ffmpeg_instance(obs_data_t* settings, obs_encoder_t* self, bool
 
 	  _codec(_factory->get_avcodec()), _context(nullptr), _handler(ffmpeg_manager::get()->get_handler(_codec->name)),
 
-	  _scaler(), _packet(),
+	  _scaler(), _conversion_cache(), _conversion_key(), _conversion_lifetime(0),
 
 	  _hwapi(), _hwinst(),
 
-	  _lag_in_frames(0), _sent_frames(0), _have_first_frame(false), _extra_data(), _sei_data(),
+	  _encode_thread(), _encode_lock(), _encode_cv(), _encode_stop(false), _encode_failed(false), _encode_input(),
+	  _encode_output(), _encode_current(), _context_lock(), _rate_control{-1, -1, -1, -1},
+	  _force_keyframe(false), _packet_lock(), _packet_pool(), _graphics_waits(0),
+	  _graphics_wait_time(0), _zero_copy(false), _zero_copy_lock(), _zero_copy_cv(), _zero_copy_refs(0),
+	  _zero_copy_timeout(0),
+
+	  _have_first_frame(false), _extra_data(), _sei_data(),
 
-	  _free_frames(), _used_frames(), _free_frames_last_used()
+	  _free_frames(ST_FRAME_POOL_SIZE), _used_frames(), _frames_lag(0),
+	  _frames_trim_interval(ST_FRAME_POOL_TRIM_INTERVAL), _frames_trim_time(std::chrono::steady_clock::now()),
+	  _latency_start(), _latency()
 {
+	for (auto& bucket : _latency) {
+		bucket.store(0);
+	}
+
+#ifdef ENABLE_PROFILING
+	// Profilers
+	_profiler_copy    = streamfx::util::profiler::create();
+	_profiler_convert = streamfx::util::profiler::create();
+	_profiler_encode  = streamfx::util::profiler::create();
+	_profiler_packet  = streamfx::util::profiler::create();
+#endif
+
+	if (auto config = streamfx::configuration::instance(); config) {
+		auto dataptr = config->get();
+		if (obs_data_has_user_value(dataptr.get(), ST_CFG_FRAME_POOL_TRIM_INTERVAL)) {
+			_frames_trim_interval = std::chrono::milliseconds(
+				std::max<long long>(obs_data_get_int(dataptr.get(), ST_CFG_FRAME_POOL_TRIM_INTERVAL), 0));
+		}
+	}
+
 	// Initialize GPU Stuff
 	if (is_hw) {
 		// Abort if user specified manual override.
@@ -125,10 +184,6 @@ ffmpeg_instance::ffmpeg_instance(obs_data_t* settings, obs_encoder_t* self, bool
 		throw std::runtime_error("Failed to create encoder context.");
 	}
 
-	// Create 8MB of precached Packet data for use later on.
-	av_init_packet(&_packet);
-	av_new_packet(&_packet, 8 * 1024 * 1024); // 8 MB precached Packet size.
-
 	// Initialize
 	if (is_hw) {
 		initialize_hw(settings);
@@ -140,24 +195,103 @@ ffmpeg_instance::ffmpeg_instance(obs_data_t* settings, obs_encoder_t* self, bool
 	update(settings);
 
 	// Initialize Encoder
-	auto gctx = streamfx::obs::gs::context();
+	auto gctx = enter_graphics();
 	int  res  = avcodec_open2(_context, _codec, NULL);
 	if (res < 0) {
 		throw std::runtime_error(::streamfx::ffmpeg::tools::get_error_description(res));
 	}
+
+	// Rate control as the encoder was opened with, which later settings changes are compared against.
+	_rate_control.bitrate       = _context->bit_rate / 1000;
+	_rate_control.buffer_size   = _context->rc_buffer_size / 1000;
+	_rate_control.quantizer_min = _context->qmin;
+	_rate_control.quantizer_max = _context->qmax;
+
+	// Initialize Frame Pool
+	_free_frames.set_resolution(_context->width, _context->height);
+	_free_frames.set_pixel_format(_context->pix_fmt);
+	if (_hwinst) {
+		_free_frames.set_allocator([this]() { return _hwinst->allocate_frame(_context->hw_frames_ctx); });
+	}
+
+	// Encoders that release their input before avcodec_send_frame returns can read OBS's memory directly. That is
+	// either one that encodes every frame right away on the calling thread, or one known to copy its input. An encoder
+	// that is merely slow to release it is caught by release_zero_copy(), which then switches to copying.
+	bool releases_input = (((_codec->capabilities & AV_CODEC_CAP_DELAY) == 0)
+						   && ((_context->active_thread_type & FF_THREAD_FRAME) == 0))
+						  || (zero_copy_encoders.count(_codec->name) > 0);
+	_zero_copy = !_hwinst && releases_input && (_scaler.is_source_full_range() == _scaler.is_target_full_range())
+				 && (_scaler.get_source_colorspace() == _scaler.get_target_colorspace())
+				 && (_scaler.get_source_format() == _scaler.get_target_format());
+	DLOG_INFO("[%s] Zero-Copy: %s", _codec->name, _zero_copy ? "Enabled" : "Disabled");
+
+	// Allocate what the pool is trimmed down to right away, instead of on the first frames of the stream.
+	if (!_zero_copy) {
+		auto usage = get_frame_pool_usage();
+		_free_frames.precache(usage.target);
+		usage = get_frame_pool_usage();
+		DLOG_INFO("[%s] Frame Pool: Preallocated %zu frames (%zu bytes).", _codec->name, usage.frames, usage.bytes);
+	}
+
+	// Waiting longer than a frame for the encoder to let go of OBS's memory costs more than copying it would have.
+	_zero_copy_timeout = std::chrono::nanoseconds(video_output_get_frame_time(obs_encoder_video(_self)));
+
+	// Other encoders converting the same frames to the same target can share the result with us. Every encoder sees
+	// a frame within the same video tick, so half a frame is more than enough time for them to pick it up.
+	if (!_hwinst && !_zero_copy) {
+		_conversion_key.source.fill(nullptr);
+		_conversion_key.source_format = _scaler.get_source_format();
+		_conversion_key.width         = _context->width;
+		_conversion_key.height        = _context->height;
+		_conversion_key.format        = _context->pix_fmt;
+		_conversion_key.colorspace    = _context->colorspace;
+		_conversion_key.range         = _context->color_range;
+
+		_conversion_lifetime = std::chrono::nanoseconds(video_output_get_frame_time(obs_encoder_video(_self)) / 2);
+		_conversion_cache    = ffmpeg_manager::get()->get_conversion_cache();
+		_conversion_cache->subscribe(_conversion_key);
+	}
+
+	// From here on, only the encoder thread talks to libavcodec.
+	_encode_thread = std::thread(std::bind(&ffmpeg_instance::encode_main, this));
 }
 
 ffmpeg_instance::~ffmpeg_instance()
 {
-	auto gctx = streamfx::obs::gs::context();
+	// Stop the encoder thread, which hands the codec context back to us.
+	if (_encode_thread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(_encode_lock);
+			_encode_stop = true;
+		}
+		_encode_cv.notify_all();
+		_encode_thread.join();
+	}
+
+	if (_conversion_cache) {
+		_conversion_cache->unsubscribe(_conversion_key);
+	}
+
+	// Packets return to the pool when released, so they have to go before it does.
+	_encode_output.clear();
+	_encode_current.reset();
+	for (auto packet : _packet_pool) {
+		av_packet_free(&packet);
+	}
+	_packet_pool.clear();
+
+	auto gctx = enter_graphics();
 	if (_context) {
 		// Flush encoders that require it.
 		if ((_codec->capabilities & AV_CODEC_CAP_DELAY) != 0) {
+			AVPacket* packet = av_packet_alloc();
 			avcodec_send_frame(_context, nullptr);
-			while (avcodec_receive_packet(_context, &_packet) >= 0) {
+			while (avcodec_receive_packet(_context, packet) >= 0) {
+				av_packet_unref(packet);
 				avcodec_send_frame(_context, nullptr);
 				std::this_thread::sleep_for(std::chrono::milliseconds(1));
 			}
+			av_packet_free(&packet);
 		}
 
 		// Close and free context.
@@ -165,9 +299,68 @@ ffmpeg_instance::~ffmpeg_instance()
 		avcodec_free_context(&_context);
 	}
 
-	av_packet_unref(&_packet);
-
 	_scaler.finalize();
+
+	{
+		std::array<uint64_t, latency_buckets> buckets;
+		get_latency_histogram(buckets);
+		for (std::size_t idx = 0; idx < buckets.size(); idx++) {
+			if (buckets[idx] == 0)
+				continue;
+			DLOG_INFO("[%s] Latency %8" PRIu64 " - %8" PRIu64 " µs: %" PRIu64 " frames", _codec->name,
+					  (uint64_t(1) << idx) - 1, (uint64_t(1) << (idx + 1)) - 1, buckets[idx]);
+		}
+	}
+
+	{
+		auto stats = _free_frames.get_statistics();
+		DLOG_INFO("[%s] Frame Pool: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " reallocations, %" PRIu64
+				  " rejected.",
+				  _codec->name, stats.hits, stats.misses, stats.reallocations, stats.rejected);
+
+		auto usage = get_frame_pool_usage();
+		DLOG_INFO("[%s] Frame Pool: %" PRIu64 " trimmed, %zu frames (%zu bytes) pooled at shutdown.", _codec->name,
+				  stats.trimmed, usage.frames, usage.bytes);
+		DLOG_INFO("[%s] Frame Pool: Peaked at %zu frames (%zu bytes).", _codec->name, usage.peak,
+				  usage.peak * _free_frames.frame_size());
+	}
+
+#ifdef ENABLE_PROFILING
+	{ // Profiling
+		auto log_profiler = [this](const char* name, std::shared_ptr<streamfx::util::profiler> profiler) {
+			DLOG_INFO("[%s] %-7s | %13.1f | %13" PRId64 " | %13" PRId64 " | %13" PRId64 " | %9" PRIu64, _codec->name,
+					  name, profiler->average_duration() / 1000.,
+					  std::chrono::duration_cast<std::chrono::microseconds>(profiler->percentile(0.999)).count(),
+					  std::chrono::duration_cast<std::chrono::microseconds>(profiler->percentile(0.990)).count(),
+					  std::chrono::duration_cast<std::chrono::microseconds>(profiler->percentile(0.950)).count(),
+					  profiler->count());
+		};
+		DLOG_INFO("[%s] Timings | Avg. µs       | 99.9ile µs    | 99.0ile µs    | 95.0ile µs    | Samples  ",
+				  _codec->name);
+		DLOG_INFO("[%s] --------+---------------+---------------+---------------+---------------+----------",
+				  _codec->name);
+		log_profiler("Copy", _profiler_copy);
+		log_profiler("Convert", _profiler_convert);
+		log_profiler("Encode", _profiler_encode);
+		log_profiler("Packet", _profiler_packet);
+
+		// The encoder thread only ever sends and receives, so this is the throughput it could sustain.
+		auto busy = _profiler_encode->total_duration() + _profiler_packet->total_duration();
+		if (busy.count() > 0) {
+			DLOG_INFO("[%s] Throughput: %.2f frames per second of encoder time.", _codec->name,
+					  static_cast<double_t>(_profiler_encode->count()) * 1000000000.
+						  / static_cast<double_t>(busy.count()));
+		}
+	}
+#endif
+
+	if (_hwinst) {
+		uint64_t                 waits;
+		std::chrono::nanoseconds time;
+		get_graphics_wait(waits, time);
+		DLOG_INFO("[%s] Graphics Context: Entered %" PRIu64 " times, waited %" PRIu64 " µs in total.", _codec->name,
+				  waits, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(time).count()));
+	}
 }
 
 void ffmpeg_instance::get_properties(obs_properties_t* props)
@@ -181,6 +374,53 @@ void ffmpeg_instance::get_properties(obs_properties_t* props)
 
 	obs_property_set_enabled(obs_properties_get(props, ST_KEY_FFMPEG_THREADS), false);
 	obs_property_set_enabled(obs_properties_get(props, ST_KEY_FFMPEG_GPU), false);
+	obs_property_set_enabled(obs_properties_get(props, ST_KEY_FFMPEG_CONVERSIONTHREADS), false);
+}
+
+bool ffmpeg_instance::apply_rate_control(const rate_control& rc)
+{
+	bool changed = false;
+
+	if (rc.bitrate >= 0) {
+		// Constant bitrate keeps its maximum in lockstep with the target.
+		if (_context->rc_max_rate == _context->bit_rate) {
+			_context->rc_max_rate = rc.bitrate * 1000;
+		}
+		if (_context->rc_min_rate == _context->bit_rate) {
+			_context->rc_min_rate = rc.bitrate * 1000;
+		}
+		_context->bit_rate    = rc.bitrate * 1000;
+		_rate_control.bitrate = rc.bitrate;
+		changed               = true;
+	}
+	if (rc.buffer_size >= 0) {
+		_context->rc_buffer_size  = static_cast<int>(rc.buffer_size * 1000);
+		_rate_control.buffer_size = rc.buffer_size;
+		changed                   = true;
+	}
+	if (rc.quantizer_min >= 0) {
+		_context->qmin              = rc.quantizer_min;
+		_rate_control.quantizer_min = rc.quantizer_min;
+		changed                     = true;
+	}
+	if (rc.quantizer_max >= 0) {
+		_context->qmax              = rc.quantizer_max;
+		_rate_control.quantizer_max = rc.quantizer_max;
+		changed                     = true;
+	}
+
+	if (changed) {
+		DLOG_INFO("[%s] Rate Control: %" PRId64 " kbit/s, %" PRId64 " kbit buffer, quantizer %" PRId32 " to %" PRId32
+				  ".",
+				  _codec->name, _rate_control.bitrate, _rate_control.buffer_size, _rate_control.quantizer_min,
+				  _rate_control.quantizer_max);
+	}
+	return changed;
+}
+
+void ffmpeg_instance::request_keyframe()
+{
+	_force_keyframe.store(true, std::memory_order_release);
 }
 
 void ffmpeg_instance::migrate(obs_data_t* settings, uint64_t version)
@@ -191,6 +431,9 @@ void ffmpeg_instance::migrate(obs_data_t* settings, uint64_t version)
 
 bool ffmpeg_instance::update(obs_data_t* settings)
 {
+	// Don't change the context while the encoder thread is using it.
+	std::unique_lock<std::mutex> context_lock(_context_lock);
+
 	bool support_reconfig           = false;
 	bool support_reconfig_threads   = false;
 	bool support_reconfig_gpu       = false;
@@ -204,6 +447,9 @@ bool ffmpeg_instance::update(obs_data_t* settings)
 		// FFmpeg Options
 		_context->debug                 = 0;
 		_context->strict_std_compliance = FF_COMPLIANCE_NORMAL;
+
+		// Requested key frames must be IDRs, some encoders only emit a recovery point otherwise.
+		av_opt_set_int(_context, "forced-idr", 1, AV_OPT_SEARCH_CHILDREN);
 	}
 
 	if (!_context->internal || (support_reconfig && support_reconfig_threads)) {
@@ -244,10 +490,10 @@ bool ffmpeg_instance::update(obs_data_t* settings)
 	if (!_context->internal || (support_reconfig && support_reconfig_keyframes)) {
 		// Keyframes
 		if (_handler && _handler->has_keyframe_support(_factory)) {
-			// Key-Frame Options
-			obs_video_info ovi;
-			if (!obs_get_video_info(&ovi)) {
-				throw std::runtime_error("obs_get_video_info failed, restart OBS Studio to fix it (hopefully).");
+			// Key-Frame Options, based on the video this encoder is attached to instead of OBS's main video.
+			const struct video_output_info* voi = video_output_get_info(obs_encoder_video(_self));
+			if (!voi) {
+				throw std::runtime_error("Encoder is not attached to any video.");
 			}
 
 			int64_t kf_type    = obs_data_get_int(settings, ST_KEY_KEYFRAMES_INTERVALTYPE);
@@ -255,7 +501,7 @@ bool ffmpeg_instance::update(obs_data_t* settings)
 
 			if (is_seconds) {
 				_context->gop_size = static_cast<int>(obs_data_get_double(settings, ST_KEY_KEYFRAMES_INTERVAL_SECONDS)
-													  * (ovi.fps_num / ovi.fps_den));
+													  * voi->fps_num / voi->fps_den);
 			} else {
 				_context->gop_size = static_cast<int>(obs_data_get_int(settings, ST_KEY_KEYFRAMES_INTERVAL_FRAMES));
 			}
@@ -263,6 +509,36 @@ bool ffmpeg_instance::update(obs_data_t* settings)
 		}
 	}
 
+	if (_context->internal && !support_reconfig) {
+		// Translate the settings on a scratch context the same way the encoder was configured, and only carry over
+		// what rate control changed. Encoders such as libx264 and NVENC check for these on every frame.
+		AVCodecContext* scratch = avcodec_alloc_context3(_codec);
+		if (scratch) {
+			if (_handler)
+				_handler->update(settings, _codec, scratch);
+
+			{ // FFmpeg Custom Options
+				const char* opts     = obs_data_get_string(settings, ST_KEY_FFMPEG_CUSTOMSETTINGS);
+				std::size_t opts_len = strnlen(opts, 65535);
+
+				parse_ffmpeg_commandline(scratch, std::string{opts, opts + opts_len});
+			}
+
+			rate_control rc{-1, -1, -1, -1};
+			if (scratch->bit_rate != _rate_control.bitrate * 1000)
+				rc.bitrate = scratch->bit_rate / 1000;
+			if (scratch->rc_buffer_size != _rate_control.buffer_size * 1000)
+				rc.buffer_size = scratch->rc_buffer_size / 1000;
+			if (scratch->qmin != _rate_control.quantizer_min)
+				rc.quantizer_min = scratch->qmin;
+			if (scratch->qmax != _rate_control.quantizer_max)
+				rc.quantizer_max = scratch->qmax;
+			avcodec_free_context(&scratch);
+
+			apply_rate_control(rc);
+		}
+	}
+
 	if (!_context->internal || support_reconfig) {
 		// Handler Options
 		if (_handler)
@@ -308,6 +584,7 @@ bool ffmpeg_instance::update(obs_data_t* settings)
 					  ::streamfx::ffmpeg::tools::get_pixel_format_name(_scaler.get_target_format()),
 					  ::streamfx::ffmpeg::tools::get_color_space_name(_scaler.get_target_colorspace()),
 					  _scaler.is_target_full_range() ? "Full" : "Partial");
+			DLOG_INFO("[%s]     Conversion Slices: %" PRIu32, _codec->name, _scaler.get_slices());
 			if (!_hwinst)
 				DLOG_INFO("[%s]     On GPU Index: %lli", _codec->name, obs_data_get_int(settings, ST_KEY_FFMPEG_GPU));
 		}
@@ -341,23 +618,14 @@ static inline void copy_data(encoder_frame* frame, AVFrame* vframe)
 			continue;
 
 		std::size_t plane_height = static_cast<size_t>(vframe->height) >> (idx ? v_chroma_shift : 0);
+		int         plane_width  =
+			av_image_get_linesize(static_cast<AVPixelFormat>(vframe->format), vframe->width, static_cast<int>(idx));
+		if (plane_width <= 0)
+			continue;
 
-		if (static_cast<uint32_t>(vframe->linesize[idx]) == frame->linesize[idx]) {
-			std::memcpy(vframe->data[idx], frame->data[idx], frame->linesize[idx] * plane_height);
-		} else {
-			std::size_t ls_in  = static_cast<size_t>(frame->linesize[idx]);
-			std::size_t ls_out = static_cast<size_t>(vframe->linesize[idx]);
-			std::size_t bytes  = ls_in < ls_out ? ls_in : ls_out;
-
-			uint8_t* to   = vframe->data[idx];
-			uint8_t* from = frame->data[idx];
-
-			for (std::size_t y = 0; y < plane_height; y++) {
-				std::memcpy(to, from, bytes);
-				to += ls_out;
-				from += ls_in;
-			}
-		}
+		::streamfx::util::plane::copy(vframe->data[idx], static_cast<size_t>(vframe->linesize[idx]), frame->data[idx],
+									  static_cast<size_t>(frame->linesize[idx]), static_cast<size_t>(plane_width),
+									  plane_height, ::streamfx::threadpool());
 	}
 }
 
@@ -368,32 +636,32 @@ bool ffmpeg_instance::encode_audio(struct encoder_frame* frame, struct encoder_p
 
 bool ffmpeg_instance::encode_video(struct encoder_frame* frame, struct encoder_packet* packet, bool* received_packet)
 {
-	std::shared_ptr<AVFrame> vframe = pop_free_frame(); // Retrieve an empty frame.
+	// Skip copying entirely if possible.
+	if (_zero_copy) {
+		if (std::shared_ptr<AVFrame> vframe = wrap_frame(frame); vframe) {
+			return encode_avframe(std::move(vframe), packet, received_packet, frame);
+		}
+	}
 
-	// Convert frame.
-	{
-		vframe->height          = _context->height;
-		vframe->format          = _context->pix_fmt;
-		vframe->color_range     = _context->color_range;
-		vframe->colorspace      = _context->colorspace;
-		vframe->color_primaries = _context->color_primaries;
-		vframe->color_trc       = _context->color_trc;
-		vframe->pts             = frame->pts;
-
-		if ((_scaler.is_source_full_range() == _scaler.is_target_full_range())
-			&& (_scaler.get_source_colorspace() == _scaler.get_target_colorspace())
-			&& (_scaler.get_source_format() == _scaler.get_target_format())) {
-			copy_data(frame, vframe.get());
-		} else {
-			int res = _scaler.convert(reinterpret_cast<uint8_t**>(frame->data), reinterpret_cast<int*>(frame->linesize),
-									  0, _context->height, vframe->data, vframe->linesize);
-			if (res <= 0) {
-				DLOG_ERROR("Failed to convert frame: %s (%" PRId32 ").",
-						   ::streamfx::ffmpeg::tools::get_error_description(res), res);
-				return false;
-			}
+	std::shared_ptr<AVFrame> vframe;
+	if (_conversion_cache && _conversion_cache->is_shared(_conversion_key)) {
+		auto id = _conversion_key;
+		for (std::size_t idx = 0; (idx < MAX_AV_PLANES) && (idx < id.source.size()); idx++) {
+			id.source[idx] = frame->data[idx];
+		}
+
+		vframe = _conversion_cache->get(id, this, _conversion_lifetime,
+										[this, frame](AVFrame* target) { return convert_frame(frame, target); });
+		if (!vframe) {
+			return false;
+		}
+	} else {
+		vframe = pop_free_frame(); // Retrieve an empty frame.
+		if (!convert_frame(frame, vframe.get())) {
+			return false;
 		}
 	}
+	vframe->pts = frame->pts;
 
 	if (!encode_avframe(vframe, packet, received_packet))
 		return false;
@@ -401,6 +669,107 @@ bool ffmpeg_instance::encode_video(struct encoder_frame* frame, struct encoder_p
 	return true;
 }
 
+bool ffmpeg_instance::convert_frame(struct encoder_frame* frame, AVFrame* vframe)
+{
+	vframe->height          = _context->height;
+	vframe->format          = _context->pix_fmt;
+	vframe->color_range     = _context->color_range;
+	vframe->colorspace      = _context->colorspace;
+	vframe->color_primaries = _context->color_primaries;
+	vframe->color_trc       = _context->color_trc;
+
+	if ((_scaler.is_source_full_range() == _scaler.is_target_full_range())
+		&& (_scaler.get_source_colorspace() == _scaler.get_target_colorspace())
+		&& (_scaler.get_source_format() == _scaler.get_target_format())) {
+#ifdef ENABLE_PROFILING
+		auto profile = _profiler_copy->track();
+#endif
+		copy_data(frame, vframe);
+	} else {
+#ifdef ENABLE_PROFILING
+		auto profile = _profiler_convert->track();
+#endif
+		int res = _scaler.convert(reinterpret_cast<uint8_t**>(frame->data), reinterpret_cast<int*>(frame->linesize), 0,
+								  _context->height, vframe->data, vframe->linesize);
+		if (res <= 0) {
+			DLOG_ERROR("Failed to convert frame: %s (%" PRId32 ").",
+					   ::streamfx::ffmpeg::tools::get_error_description(res), res);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<AVFrame> ffmpeg_instance::wrap_frame(struct encoder_frame* frame)
+{
+	int h_chroma_shift, v_chroma_shift;
+	av_pix_fmt_get_chroma_sub_sample(_context->pix_fmt, &h_chroma_shift, &v_chroma_shift);
+
+	// Encoders expect the same alignment that av_frame_get_buffer() would give them.
+	std::size_t planes = 0;
+	for (std::size_t idx = 0; idx < MAX_AV_PLANES; idx++) {
+		if (!frame->data[idx])
+			break;
+		if (((reinterpret_cast<uintptr_t>(frame->data[idx]) % ST_ZERO_COPY_ALIGNMENT) != 0)
+			|| ((frame->linesize[idx] % ST_ZERO_COPY_ALIGNMENT) != 0)) {
+			return nullptr;
+		}
+		planes++;
+	}
+	if ((planes == 0) || (planes > AV_NUM_DATA_POINTERS)) {
+		return nullptr;
+	}
+
+	std::shared_ptr<AVFrame> vframe = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame) {
+		av_frame_unref(frame);
+		av_frame_free(&frame);
+	});
+	vframe->width           = _context->width;
+	vframe->height          = _context->height;
+	vframe->format          = _context->pix_fmt;
+	vframe->color_range     = _context->color_range;
+	vframe->colorspace      = _context->colorspace;
+	vframe->color_primaries = _context->color_primaries;
+	vframe->color_trc       = _context->color_trc;
+	vframe->pts             = frame->pts;
+	vframe->opaque          = this; // Marks the frame as not poolable.
+
+	{
+		std::unique_lock<std::mutex> lock(_zero_copy_lock);
+		_zero_copy_refs = planes;
+	}
+	for (std::size_t idx = 0; idx < planes; idx++) {
+		std::size_t plane_height = static_cast<size_t>(vframe->height) >> (idx ? v_chroma_shift : 0);
+
+		vframe->data[idx]     = frame->data[idx];
+		vframe->linesize[idx] = static_cast<int>(frame->linesize[idx]);
+		vframe->buf[idx]      = av_buffer_create(frame->data[idx], static_cast<int>(frame->linesize[idx] * plane_height),
+											 &ffmpeg_instance::zero_copy_free, this, AV_BUFFER_FLAG_READONLY);
+		if (!vframe->buf[idx]) {
+			// Release what we already wrapped, the rest will never be referenced.
+			{
+				std::unique_lock<std::mutex> lock(_zero_copy_lock);
+				_zero_copy_refs -= (planes - idx);
+			}
+			vframe.reset();
+			return nullptr;
+		}
+	}
+
+	return vframe;
+}
+
+void ffmpeg_instance::zero_copy_free(void* opaque, uint8_t*)
+{
+	auto self = reinterpret_cast<ffmpeg_instance*>(opaque);
+	{
+		std::unique_lock<std::mutex> lock(self->_zero_copy_lock);
+		self->_zero_copy_refs--;
+	}
+	self->_zero_copy_cv.notify_all();
+}
+
 bool ffmpeg_instance::encode_video(uint32_t handle, int64_t pts, uint64_t lock_key, uint64_t* next_key,
 								   struct encoder_packet* packet, bool* received_packet)
 {
@@ -466,6 +835,7 @@ void ffmpeg_instance::initialize_sw(obs_data_t* settings)
 		_scaler.set_target_size(static_cast<uint32_t>(_context->width), static_cast<uint32_t>(_context->height));
 		_scaler.set_target_color(_context->color_range == AVCOL_RANGE_JPEG, _context->colorspace);
 		_scaler.set_target_format(pix_fmt_target);
+		_scaler.set_slices(static_cast<uint32_t>(obs_data_get_int(settings, ST_KEY_FFMPEG_CONVERSIONTHREADS)));
 
 		// Create Scaler
 		if (!_scaler.initialize(SWS_POINT)) {
@@ -519,54 +889,80 @@ void ffmpeg_instance::initialize_hw(obs_data_t*)
 
 void ffmpeg_instance::push_free_frame(std::shared_ptr<AVFrame> frame)
 {
-	auto now = std::chrono::high_resolution_clock::now();
-	if (_free_frames.size() > 0) {
-		if ((now - _free_frames_last_used) < std::chrono::seconds(1)) {
-			_free_frames.push(frame);
-		}
-	} else {
-		_free_frames.push(frame);
-		_free_frames_last_used = std::chrono::high_resolution_clock::now();
+	// Zero-copy frames point at OBS's memory and shared frames belong to the conversion cache, neither can be reused.
+	if (!frame || frame->opaque) {
+		return;
+	}
+
+	// If the pool is full, the frame is simply released.
+	if (!_free_frames.push(frame)) {
+		DLOG_DEBUG("[%s] Frame Pool: Full, releasing a frame.", _codec->name);
 	}
 }
 
 std::shared_ptr<AVFrame> ffmpeg_instance::pop_free_frame()
 {
-	std::shared_ptr<AVFrame> frame;
-	if (_free_frames.size() > 0) {
-		// Re-use existing frames first.
-		frame = _free_frames.top();
-		_free_frames.pop();
-	} else {
-		if (_hwinst) {
-			frame = _hwinst->allocate_frame(_context->hw_frames_ctx);
-		} else {
-			frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame) {
-				av_frame_unref(frame);
-				av_frame_free(&frame);
-			});
+	trim_free_frames();
+	if (auto frame = _free_frames.try_pop(); frame) {
+		return frame;
+	}
 
-			frame->width  = _context->width;
-			frame->height = _context->height;
-			frame->format = _context->pix_fmt;
+	// The encoder holds on to more frames than the pool had ready, which is only expected early on.
+	DLOG_DEBUG("[%s] Frame Pool: Empty, allocating a frame.", _codec->name);
+	return _free_frames.pop();
+}
 
-			int res = av_frame_get_buffer(frame.get(), 32);
-			if (res < 0) {
-				throw std::runtime_error(::streamfx::ffmpeg::tools::get_error_description(res));
-			}
-		}
+void ffmpeg_instance::trim_free_frames()
+{
+	if (_frames_trim_interval.count() == 0) {
+		return;
 	}
 
-	return frame;
+	auto now = std::chrono::steady_clock::now();
+	if ((now - _frames_trim_time) < _frames_trim_interval) {
+		return;
+	}
+	_frames_trim_time = now;
+
+	// Keep what the encoder needed at its worst since the last trim, and let the next interval measure again.
+	std::size_t target = get_frame_pool_usage().target;
+	_frames_lag.store(0, std::memory_order_relaxed);
+
+	if (std::size_t count = _free_frames.trim(target); count > 0) {
+		auto usage = get_frame_pool_usage();
+		DLOG_DEBUG("[%s] Frame Pool: Released %zu idle frames, %zu frames (%zu bytes) remain pooled.", _codec->name,
+				   count, usage.frames, usage.bytes);
+	}
+}
+
+ffmpeg_instance::frame_pool_usage ffmpeg_instance::get_frame_pool_usage()
+{
+	frame_pool_usage usage;
+	usage.frames = _free_frames.size();
+	usage.bytes  = usage.frames * _free_frames.frame_size();
+	usage.peak   = static_cast<std::size_t>(_free_frames.get_statistics().peak);
+	// Frames held by the encoder, queued for it, and the one being filled right now.
+	usage.target = _frames_lag.load(std::memory_order_relaxed) + ST_ENCODE_QUEUE_INPUT + 1;
+	return usage;
 }
 
 void ffmpeg_instance::push_used_frame(std::shared_ptr<AVFrame> frame)
 {
 	_used_frames.push(frame);
+
+	// Track the encoder's lag in frames, which is what the pool has to cover.
+	std::size_t lag  = _used_frames.size();
+	std::size_t peak = _frames_lag.load(std::memory_order_relaxed);
+	while ((lag > peak) && !_frames_lag.compare_exchange_weak(peak, lag, std::memory_order_relaxed)) {
+	}
 }
 
 std::shared_ptr<AVFrame> ffmpeg_instance::pop_used_frame()
 {
+	if (_used_frames.empty()) {
+		return nullptr;
+	}
+
 	auto frame = _used_frames.front();
 	_used_frames.pop();
 	return frame;
@@ -600,28 +996,65 @@ void ffmpeg_instance::get_video_info(struct video_scale_info* info)
 	}
 }
 
-int ffmpeg_instance::receive_packet(bool* received_packet, struct encoder_packet* packet)
+bool ffmpeg_instance::get_statistics(streamfx_encoder_statistics* statistics)
+{
+#ifdef ENABLE_PROFILING
+	fill_stage(statistics->copy, _profiler_copy);
+	fill_stage(statistics->convert, _profiler_convert);
+	fill_stage(statistics->encode, _profiler_encode);
+	fill_stage(statistics->packet, _profiler_packet);
+#endif
+
+	statistics->pool_peak_bytes = get_frame_pool_usage().peak * _free_frames.frame_size();
+
+	std::chrono::nanoseconds wait_time;
+	get_graphics_wait(statistics->graphics_waits, wait_time);
+	statistics->graphics_wait_ns = static_cast<uint64_t>(wait_time.count());
+	return true;
+}
+
+int ffmpeg_instance::receive_packet(std::shared_ptr<AVPacket>& packet)
 {
 	int res = 0;
 
-	av_packet_unref(&_packet);
+	packet = pop_free_packet();
+	if (!packet) {
+		return AVERROR(ENOMEM);
+	}
 
 	{
-		auto gctx = streamfx::obs::gs::context();
-		res       = avcodec_receive_packet(_context, &_packet);
+#ifdef ENABLE_PROFILING
+		auto profile = _profiler_packet->track();
+#endif
+		auto gctx = enter_graphics();
+		res       = avcodec_receive_packet(_context, packet.get());
 	}
 	if (res != 0) {
+		packet.reset();
 		return res;
 	}
 
 	if (!_have_first_frame) {
-		if (_codec->id == AV_CODEC_ID_H264) {
+		h264::header_sei units;
+		const uint8_t*   av1_header    = nullptr;
+		std::size_t      sz_av1_header = 0;
+		if ((_codec->id == AV_CODEC_ID_H264)
+			&& h264::extract_header_sei(packet->data, static_cast<size_t>(packet->size), units)) {
+			for (std::size_t idx = 0; idx < units.header_count; idx++) {
+				_extra_data.insert(_extra_data.end(), units.header[idx].data,
+								   units.header[idx].data + units.header[idx].size);
+			}
+			for (std::size_t idx = 0; idx < units.sei_count; idx++) {
+				_sei_data.insert(_sei_data.end(), units.sei[idx].data, units.sei[idx].data + units.sei[idx].size);
+			}
+		} else if (_codec->id == AV_CODEC_ID_H264) {
+			// More parameter sets than fit into the views, let libobs sort them out.
 			uint8_t*    tmp_packet;
 			uint8_t*    tmp_header;
 			uint8_t*    tmp_sei;
 			std::size_t sz_packet, sz_header, sz_sei;
 
-			obs_extract_avc_headers(_packet.data, static_cast<size_t>(_packet.size), &tmp_packet, &sz_packet,
+			obs_extract_avc_headers(packet->data, static_cast<size_t>(packet->size), &tmp_packet, &sz_packet,
 									&tmp_header, &sz_header, &tmp_sei, &sz_sei);
 
 			if (sz_header) {
@@ -642,7 +1075,12 @@ int ffmpeg_instance::receive_packet(bool* received_packet, struct encoder_packet
 			bfree(tmp_header);
 			bfree(tmp_sei);
 		} else if (_codec->id == AV_CODEC_ID_HEVC) {
-			hevc::extract_header_sei(_packet.data, static_cast<size_t>(_packet.size), _extra_data, _sei_data);
+			hevc::extract_header_sei(packet->data, static_cast<size_t>(packet->size), _extra_data, _sei_data);
+		} else if ((_codec->id == AV_CODEC_ID_AV1)
+				   && av1::find_sequence_header(packet->data, static_cast<size_t>(packet->size), av1_header,
+												sz_av1_header)) {
+			// Encoders disagree on what goes into their extra data, but libobs always wants the plain OBU.
+			_extra_data.assign(av1_header, av1_header + sz_av1_header);
 		} else if (_context->extradata != nullptr) {
 			_extra_data.resize(static_cast<size_t>(_context->extradata_size));
 			std::memcpy(_extra_data.data(), _context->extradata, static_cast<size_t>(_context->extradata_size));
@@ -652,29 +1090,43 @@ int ffmpeg_instance::receive_packet(bool* received_packet, struct encoder_packet
 
 	// Allow Handler Post-Processing
 	if (_handler)
-		_handler->process_avpacket(_packet, _codec, _context);
+		_handler->process_avpacket(*packet, _codec, _context);
+
+	// Push free frame back into pool.
+	push_free_frame(pop_used_frame());
 
+	return res;
+}
+
+void ffmpeg_instance::build_packet(std::shared_ptr<AVPacket> av_packet, struct encoder_packet* packet)
+{
 	// Build packet for use in OBS.
 	packet->type     = OBS_ENCODER_VIDEO;
-	packet->pts      = _packet.pts;
-	packet->dts      = _packet.dts;
-	packet->data     = _packet.data;
-	packet->size     = static_cast<size_t>(_packet.size);
-	packet->keyframe = !!(_packet.flags & AV_PKT_FLAG_KEY);
-	*received_packet = true;
+	packet->pts      = av_packet->pts;
+	packet->dts      = av_packet->dts;
+	packet->data     = av_packet->data;
+	packet->size     = static_cast<size_t>(av_packet->size);
+	packet->keyframe = !!(av_packet->flags & AV_PKT_FLAG_KEY);
+	if (!packet->keyframe && (_codec->id == AV_CODEC_ID_AV1)) {
+		// Not every AV1 encoder flags its key frames, but they are cheap to spot.
+		packet->keyframe = av1::is_keyframe(packet->data, packet->size);
+	}
 
 	// Figure out priority and drop_priority.
 	// In theory, this is done by OBS, but its not doing a great job.
 	packet->priority      = packet->keyframe ? 3 : 2;
 	packet->drop_priority = 3;
-	for (size_t idx = 0, edx = _packet.side_data_elems; idx < edx; idx++) {
-		auto& side_data = _packet.side_data[idx];
+	bool have_stats       = false;
+	for (size_t idx = 0, edx = av_packet->side_data_elems; idx < edx; idx++) {
+		auto& side_data = av_packet->side_data[idx];
 		if (side_data.type == AV_PKT_DATA_QUALITY_STATS) {
+			have_stats = true;
+
 			// Decisions based on picture type, if present.
 			switch (side_data.data[sizeof(uint32_t)]) {
 			case AV_PICTURE_TYPE_I:  // I-Frame
 			case AV_PICTURE_TYPE_SI: // Switching I-Frame
-				if (_packet.flags & AV_PKT_FLAG_KEY) {
+				if (av_packet->flags & AV_PKT_FLAG_KEY) {
 					// Recovery only via IDR-Frame.
 					packet->priority      = 3; // OBS_NAL_PRIORITY_HIGHEST
 					packet->drop_priority = 2; // OBS_NAL_PRIORITY_HIGH
@@ -709,100 +1161,318 @@ int ffmpeg_instance::receive_packet(bool* received_packet, struct encoder_packet
 		}
 	}
 
-	// Push free frame back into pool.
-	push_free_frame(pop_used_frame());
-
-	return res;
+	// Most encoders, and all hardware encoders, never report picture types, so look at the bitstream instead.
+	if (!have_stats) {
+		int  priority      = 0;
+		int  drop_priority = 0;
+		bool known         = false;
+		switch (_codec->id) {
+		case AV_CODEC_ID_H264:
+			known = h264::get_packet_priority(packet->data, packet->size, priority, drop_priority);
+			break;
+		case AV_CODEC_ID_HEVC:
+			known = hevc::get_packet_priority(packet->data, packet->size, priority, drop_priority);
+			break;
+		case AV_CODEC_ID_AV1:
+			known = av1::get_packet_priority(packet->data, packet->size, priority, drop_priority);
+			break;
+		default:
+			break;
+		}
+		if (known) {
+			packet->priority      = priority;
+			packet->drop_priority = drop_priority;
+		}
+	}
 }
 
 int ffmpeg_instance::send_frame(std::shared_ptr<AVFrame> const frame)
 {
 	int res = 0;
 	{
-		auto gctx = streamfx::obs::gs::context();
+#ifdef ENABLE_PROFILING
+		auto profile = _profiler_encode->track();
+#endif
+		auto gctx = enter_graphics();
 		res       = avcodec_send_frame(_context, frame.get());
 	}
-	if (res == 0) {
+	if ((res == 0) && !frame->opaque) {
+		// Zero-copy and shared frames are tracked by their buffers instead, keeping them would delay their release.
 		push_used_frame(frame);
 	}
 
 	return res;
 }
 
-bool ffmpeg_instance::encode_avframe(std::shared_ptr<AVFrame> frame, encoder_packet* packet, bool* received_packet)
+bool ffmpeg_instance::encode_avframe(std::shared_ptr<AVFrame> frame, encoder_packet* packet, bool* received_packet,
+									 struct encoder_frame* source)
 {
-	bool sent_frame  = false;
-	bool recv_packet = false;
-	bool should_lag  = (_sent_frames >= _lag_in_frames);
+	std::unique_lock<std::mutex> lock(_encode_lock);
+
+	// Wait for room in the input queue. A full output queue means the encoder thread is waiting on us, in which case
+	// the frame is queued anyway so that we can hand out a packet.
+	_encode_cv.wait(lock, [this]() {
+		return _encode_failed || (_encode_input.size() < ST_ENCODE_QUEUE_INPUT)
+			   || (_encode_output.size() >= ST_ENCODE_QUEUE_OUTPUT);
+	});
+	if (_encode_failed) {
+		return false;
+	}
 
-	auto loop_begin = std::chrono::high_resolution_clock::now();
-	auto loop_end   = loop_begin + std::chrono::milliseconds(50);
+	// Hand the frame to the encoder thread.
+	_latency_start.emplace(frame->pts, std::chrono::high_resolution_clock::now());
+	if (_latency_start.size() > ST_ENCODE_LATENCY_TRACKED) {
+		_latency_start.erase(_latency_start.begin());
+	}
+	AVFrame* queued = frame.get();
+	_encode_input.emplace_back(std::move(frame));
+
+	// Hand out the oldest finished packet, if there is one. It must stay valid until the next call. This happens before
+	// waiting on a zero-copy frame, so that the encoder thread always finds room for the packets it produces.
+	_encode_current.reset();
+	if (!_encode_output.empty()) {
+		_encode_current = std::move(_encode_output.front());
+		_encode_output.pop_front();
+	}
 
-	while ((!sent_frame || (should_lag && !recv_packet)) && !(std::chrono::high_resolution_clock::now() > loop_end)) {
-		bool eagain_is_stupid = false;
+	lock.unlock();
+	_encode_cv.notify_all();
 
-		if (!sent_frame) {
-			int res = send_frame(frame);
-			switch (res) {
-			case 0:
-				sent_frame = true;
-				frame      = nullptr;
-				break;
-			case AVERROR(EAGAIN):
-				// This means we should call receive_packet again, but what do we do with that data?
-				// Why can't we queue on both? Do I really have to implement threading for this stuff?
-				if (*received_packet == true) {
-					DLOG_WARNING("Skipped frame due to EAGAIN when a packet was already returned.");
-					sent_frame = true;
-				}
-				eagain_is_stupid = true;
-				break;
-			case AVERROR(EOF):
-				DLOG_ERROR("Skipped frame due to end of stream.");
-				sent_frame = true;
-				break;
-			default:
-				DLOG_ERROR("Failed to encode frame: %s (%" PRId32 ").",
-						   ::streamfx::ffmpeg::tools::get_error_description(res), res);
-				return false;
+	// Frames wrapping OBS's memory must be released by the encoder before we return.
+	if (source) {
+		release_zero_copy(queued, source);
+	}
+
+	if (_encode_current) {
+		build_packet(_encode_current, packet);
+		*received_packet = true;
+	}
+
+	return true;
+}
+
+void ffmpeg_instance::release_zero_copy(AVFrame* queued, struct encoder_frame* source)
+{
+	{
+		std::unique_lock<std::mutex> zc_lock(_zero_copy_lock);
+		if (_zero_copy_cv.wait_for(zc_lock, _zero_copy_timeout, [this]() { return _zero_copy_refs == 0; })) {
+			return;
+		}
+	}
+
+	// The encoder is falling behind, so copy the frame if it has not picked it up yet. An encoder that is this slow
+	// once will be again, so later frames are copied right away.
+	DLOG_WARNING("[%s] Encoder did not release a zero-copy frame in time, falling back to copying.", _codec->name);
+	_zero_copy = false;
+
+	std::shared_ptr<AVFrame> wrapped;
+	{
+		// Only this thread queues frames, so ours is still the last one if it is queued at all.
+		std::unique_lock<std::mutex> lock(_encode_lock);
+		if (!_encode_input.empty() && (_encode_input.back().get() == queued)) {
+			wrapped = std::move(_encode_input.back());
+			_encode_input.pop_back();
+		}
+	}
+	if (wrapped) {
+		std::shared_ptr<AVFrame> vframe = pop_free_frame();
+		if (convert_frame(source, vframe.get())) {
+			vframe->pts = wrapped->pts;
+			{
+				std::unique_lock<std::mutex> lock(_encode_lock);
+				_encode_input.emplace_back(std::move(vframe));
 			}
+			_encode_cv.notify_all();
 		}
+		wrapped.reset();
+	}
 
-		if (!recv_packet) {
-			int res = receive_packet(received_packet, packet);
-			switch (res) {
-			case 0:
-				recv_packet = true;
-				break;
-			case AVERROR(EOF):
-				DLOG_ERROR("Received end of file.");
-				recv_packet = true;
-				break;
-			case AVERROR(EAGAIN):
-				if (sent_frame) {
-					recv_packet = true;
-				}
-				if (eagain_is_stupid) {
+	// Otherwise the encoder thread already has it, and lets go of it as soon as it has been sent.
+	std::unique_lock<std::mutex> zc_lock(_zero_copy_lock);
+	while (!_zero_copy_cv.wait_for(zc_lock, std::chrono::seconds(1), [this]() { return _zero_copy_refs == 0; })) {
+		DLOG_WARNING("[%s] Encoder is holding on to a zero-copy frame, waiting...", _codec->name);
+	}
+}
+
+void ffmpeg_instance::get_graphics_wait(uint64_t& waits, std::chrono::nanoseconds& time)
+{
+	waits = _graphics_waits.load(std::memory_order_relaxed);
+	time  = std::chrono::nanoseconds(_graphics_wait_time.load(std::memory_order_relaxed));
+}
+
+std::shared_ptr<AVPacket> ffmpeg_instance::pop_free_packet()
+{
+	AVPacket* packet = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(_packet_lock);
+		if (!_packet_pool.empty()) {
+			packet = _packet_pool.back();
+			_packet_pool.pop_back();
+		}
+	}
+	if (!packet) {
+		packet = av_packet_alloc();
+		if (!packet) {
+			return nullptr;
+		}
+	}
+
+	// Whoever drops the last reference, OBS's thread or ours, hands the packet back for reuse.
+	return std::shared_ptr<AVPacket>(packet, [this](AVPacket* ptr) { push_free_packet(ptr); });
+}
+
+void ffmpeg_instance::push_free_packet(AVPacket* packet)
+{
+	av_packet_unref(packet);
+	{
+		std::unique_lock<std::mutex> lock(_packet_lock);
+		if (_packet_pool.size() < ST_PACKET_POOL_SIZE) {
+			_packet_pool.push_back(packet);
+			return;
+		}
+	}
+	av_packet_free(&packet);
+}
+
+std::unique_ptr<::streamfx::obs::gs::context> ffmpeg_instance::enter_graphics()
+{
+	// Software encoders never touch OBS's device, and entering would only serialize them against rendering.
+	if (!_hwinst) {
+		return nullptr;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto gctx  = std::make_unique<::streamfx::obs::gs::context>();
+	auto time  = std::chrono::high_resolution_clock::now() - start;
+	_graphics_waits.fetch_add(1, std::memory_order_relaxed);
+	_graphics_wait_time.fetch_add(
+		static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()),
+		std::memory_order_relaxed);
+	return gctx;
+}
+
+void ffmpeg_instance::get_latency_histogram(std::array<uint64_t, latency_buckets>& buckets)
+{
+	for (std::size_t idx = 0; idx < latency_buckets; idx++) {
+		buckets[idx] = _latency[idx].load(std::memory_order_relaxed);
+	}
+}
+
+void ffmpeg_instance::encode_main()
+{
+	std::vector<std::shared_ptr<AVPacket>> packets;
+
+	std::unique_lock<std::mutex> lock(_encode_lock);
+	while (!_encode_stop) {
+		_encode_cv.wait(lock, [this]() { return _encode_stop || !_encode_input.empty(); });
+		if (_encode_stop) {
+			break;
+		}
+
+		auto frame = std::move(_encode_input.front());
+		_encode_input.pop_front();
+		lock.unlock();
+		_encode_cv.notify_all();
+
+		bool failed = false;
+		{
+			std::unique_lock<std::mutex> context_lock(_context_lock);
+
+			// Pooled frames are reused, so the picture type has to be reset every time.
+			bool keyframe    = _force_keyframe.exchange(false, std::memory_order_acq_rel);
+			frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+			int res = send_frame(frame);
+			while (res == AVERROR(EAGAIN)) {
+				// The encoder wants packets taken out before it accepts more input.
+				int drained = encode_drain(packets);
+				if (drained == 0) {
 					DLOG_ERROR("Both send and recieve returned EAGAIN, encoder is broken.");
-					return false;
+					failed = true;
+					break;
+				} else if (drained < 0) {
+					failed = true;
+					break;
+				}
+				res = send_frame(frame);
+			}
+
+			// Let go of the frame as early as possible, OBS's thread waits on this for frames wrapping its memory.
+			if (res != 0) {
+				push_free_frame(frame);
+			}
+			frame.reset();
+
+			if (!failed) {
+				if (res == AVERROR(EOF)) {
+					DLOG_ERROR("Skipped frame due to end of stream.");
+				} else if (res < 0) {
+					DLOG_ERROR("Failed to encode frame: %s (%" PRId32 ").",
+							   ::streamfx::ffmpeg::tools::get_error_description(res), res);
+					failed = true;
+				} else if (encode_drain(packets) < 0) {
+					failed = true;
 				}
-				break;
-			default:
-				DLOG_ERROR("Failed to receive packet: %s (%" PRId32 ").",
-						   ::streamfx::ffmpeg::tools::get_error_description(res), res);
-				return false;
 			}
 		}
 
-		if (!sent_frame || !recv_packet) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		// Only hand the packets to OBS once the context is unlocked, as that may have to wait for room.
+		queue_packets(packets);
+
+		lock.lock();
+		if (failed) {
+			_encode_failed = true;
+			_encode_cv.notify_all();
 		}
 	}
+}
 
-	if (!sent_frame)
-		push_free_frame(frame);
+int ffmpeg_instance::encode_drain(std::vector<std::shared_ptr<AVPacket>>& packets)
+{
+	int received = 0;
+	while (true) {
+		std::shared_ptr<AVPacket> packet;
+
+		int res = receive_packet(packet);
+		if ((res == AVERROR(EAGAIN)) || (res == AVERROR(EOF))) {
+			return received;
+		} else if (res < 0) {
+			DLOG_ERROR("Failed to receive packet: %s (%" PRId32 ").",
+					   ::streamfx::ffmpeg::tools::get_error_description(res), res);
+			return res;
+		}
+		received++;
 
-	return true;
+		packets.emplace_back(std::move(packet));
+	}
+}
+
+void ffmpeg_instance::queue_packets(std::vector<std::shared_ptr<AVPacket>>& packets)
+{
+	if (packets.empty()) {
+		return;
+	}
+
+	// Queue the packets for OBS, waiting for room if necessary.
+	auto                         now = std::chrono::high_resolution_clock::now();
+	std::unique_lock<std::mutex> lock(_encode_lock);
+	for (auto& packet : packets) {
+		if (auto kv = _latency_start.find(packet->pts); kv != _latency_start.end()) {
+			auto        us     = std::chrono::duration_cast<std::chrono::microseconds>(now - kv->second).count();
+			std::size_t bucket = 0;
+			while ((bucket < (latency_buckets - 1)) && ((us >> (bucket + 1)) > 0)) {
+				bucket++;
+			}
+			_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+			_latency_start.erase(kv);
+		}
+
+		_encode_cv.wait(lock, [this]() { return _encode_stop || (_encode_output.size() < ST_ENCODE_QUEUE_OUTPUT); });
+		_encode_output.emplace_back(std::move(packet));
+	}
+	packets.clear();
+	lock.unlock();
+	_encode_cv.notify_all();
 }
 
 bool ffmpeg_instance::is_hardware_encode()
@@ -821,6 +1491,11 @@ const AVCodecContext* ffmpeg_instance::get_avcodeccontext()
 }
 
 void ffmpeg_instance::parse_ffmpeg_commandline(std::string text)
+{
+	parse_ffmpeg_commandline(_context, text);
+}
+
+void ffmpeg_instance::parse_ffmpeg_commandline(AVCodecContext* context, std::string text)
 {
 	// Steps to properly parse a command line:
 	// 1. Split by space and package by quotes.
@@ -934,7 +1609,7 @@ void ffmpeg_instance::parse_ffmpeg_commandline(std::string text)
 			std::string key   = opt.substr(1, static_cast<size_t>((eq_at - cstr) - 1));
 			std::string value = opt.substr(static_cast<size_t>((eq_at - cstr) + 1));
 
-			int res = av_opt_set(_context, key.c_str(), value.c_str(), AV_OPT_SEARCH_CHILDREN);
+			int res = av_opt_set(context, key.c_str(), value.c_str(), AV_OPT_SEARCH_CHILDREN);
 			if (res < 0) {
 				DLOG_WARNING("Option '%s' (key: '%s', value: '%s') encountered error: %s", opt.c_str(), key.c_str(),
 							 value.c_str(), ::streamfx::ffmpeg::tools::get_error_description(res));
@@ -1037,6 +1712,7 @@ void ffmpeg_factory::get_defaults2(obs_data_t* settings)
 		obs_data_set_default_string(settings, ST_KEY_FFMPEG_CUSTOMSETTINGS, "");
 		obs_data_set_default_int(settings, ST_KEY_FFMPEG_THREADS, 0);
 		obs_data_set_default_int(settings, ST_KEY_FFMPEG_GPU, -1);
+		obs_data_set_default_int(settings, ST_KEY_FFMPEG_CONVERSIONTHREADS, 0);
 	}
 }
 
@@ -1131,6 +1807,12 @@ obs_properties_t* ffmpeg_factory::get_properties2(instance_t* data)
 			auto p = obs_properties_add_int_slider(grp, ST_KEY_FFMPEG_THREADS, D_TRANSLATE(ST_I18N_FFMPEG_THREADS), 0,
 												   static_cast<int64_t>(std::thread::hardware_concurrency() * 2), 1);
 		}
+
+		{ // Color Conversion Threads, 0 is automatic.
+			auto p = obs_properties_add_int_slider(grp, ST_KEY_FFMPEG_CONVERSIONTHREADS,
+												   D_TRANSLATE(ST_I18N_FFMPEG_CONVERSIONTHREADS), 0,
+												   static_cast<int64_t>(std::thread::hardware_concurrency()), 1);
+		}
 	};
 
 	return props;
@@ -1155,7 +1837,9 @@ obs_encoder_info* streamfx::encoder::ffmpeg::ffmpeg_factory::get_info()
 	return &_info;
 }
 
-ffmpeg_manager::ffmpeg_manager() : _factories(), _handlers(), _debug_handler()
+ffmpeg_manager::ffmpeg_manager()
+	: _factories(), _handlers(), _debug_handler(),
+	  _conversion_cache(std::make_shared<::streamfx::ffmpeg::avframe_cache>())
 {
 	// Handlers
 	_debug_handler = ::std::make_shared<handler::debug_handler>();
@@ -1237,6 +1921,11 @@ bool ffmpeg_manager::has_handler(std::string codec)
 
 std::shared_ptr<ffmpeg_manager> _ffmepg_encoder_factory_instance = nullptr;
 
+std::shared_ptr<::streamfx::ffmpeg::avframe_cache> ffmpeg_manager::get_conversion_cache()
+{
+	return _conversion_cache;
+}
+
 void ffmpeg_manager::initialize()
 {
 	if (!_ffmepg_encoder_factory_instance) {
@@ -21,17 +21,22 @@
 
 #pragma once
 #include "common.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <queue>
-#include <stack>
 #include <thread>
 #include <vector>
+#include "ffmpeg/avframe-cache.hpp"
 #include "ffmpeg/avframe-queue.hpp"
 #include "ffmpeg/hwapi/base.hpp"
 #include "ffmpeg/swscale.hpp"
 #include "handlers/handler.hpp"
+#include "obs/gs/gs-helper.hpp"
 #include "obs/obs-encoder-factory.hpp"
 
 extern "C" {
@@ -58,23 +63,85 @@ namespace streamfx::encoder::ffmpeg {
 		std::shared_ptr<handler::handler> _handler;
 
 		::streamfx::ffmpeg::swscale _scaler;
-		AVPacket                    _packet;
+
+		// Conversions shared with other encoders fed the same frames.
+		std::shared_ptr<::streamfx::ffmpeg::avframe_cache> _conversion_cache;
+		::streamfx::ffmpeg::avframe_cache::key             _conversion_key;
+		std::chrono::nanoseconds                           _conversion_lifetime;
 
 		std::shared_ptr<::streamfx::ffmpeg::hwapi::base>     _hwapi;
 		std::shared_ptr<::streamfx::ffmpeg::hwapi::instance> _hwinst;
 
-		std::size_t _lag_in_frames;
-		std::size_t _sent_frames;
+		// Encoder Thread, owns the codec context once opened.
+		std::thread                           _encode_thread;
+		std::mutex                            _encode_lock;
+		std::condition_variable               _encode_cv;
+		bool                                  _encode_stop;
+		bool                                  _encode_failed;
+		std::deque<std::shared_ptr<AVFrame>>  _encode_input;
+		std::deque<std::shared_ptr<AVPacket>> _encode_output;
+		std::shared_ptr<AVPacket>             _encode_current;
+		std::mutex                            _context_lock;
+
+		// Rate control as last configured, to tell which values a settings change touched. -1 leaves a value as is.
+		struct rate_control {
+			int64_t bitrate;       // Target bitrate in kbit/s.
+			int64_t buffer_size;   // Rate control buffer in kbit.
+			int32_t quantizer_min; // Lowest quantizer, in the encoder's own scale.
+			int32_t quantizer_max; // Highest quantizer, in the encoder's own scale.
+		};
+		rate_control      _rate_control;
+		std::atomic<bool> _force_keyframe;
+
+		// Packets are recycled instead of being allocated for every frame.
+		std::mutex             _packet_lock;
+		std::vector<AVPacket*> _packet_pool;
+
+		// Time spent waiting for OBS's graphics context, which only hardware encoders need.
+		std::atomic<uint64_t> _graphics_waits;
+		std::atomic<uint64_t> _graphics_wait_time;
+
+		// Zero-Copy, encode straight from OBS's memory if the encoder is done with it before we return.
+		bool                     _zero_copy;
+		std::mutex               _zero_copy_lock;
+		std::condition_variable  _zero_copy_cv;
+		std::size_t              _zero_copy_refs;
+		std::chrono::nanoseconds _zero_copy_timeout;
 
 		// Extra Data
 		bool                 _have_first_frame;
 		std::vector<uint8_t> _extra_data;
 		std::vector<uint8_t> _sei_data;
 
-		// Frame Stack and Queue
-		std::stack<std::shared_ptr<AVFrame>>           _free_frames;
-		std::queue<std::shared_ptr<AVFrame>>           _used_frames;
-		std::chrono::high_resolution_clock::time_point _free_frames_last_used;
+		// Frame Pool and Queue
+		::streamfx::ffmpeg::avframe_queue     _free_frames;
+		std::queue<std::shared_ptr<AVFrame>>  _used_frames;
+		std::atomic<std::size_t>              _frames_lag;     // Highest number of frames held by the encoder.
+		std::chrono::milliseconds             _frames_trim_interval;
+		std::chrono::steady_clock::time_point _frames_trim_time;
+
+		public:
+		struct frame_pool_usage {
+			std::size_t frames; // Idle frames currently pooled.
+			std::size_t bytes;  // Approximate memory held by the idle frames.
+			std::size_t target; // Number of frames the pool is trimmed down to.
+			std::size_t peak;   // Most frames ever pooled at once.
+		};
+
+		public:
+		// Bucket n counts frames which took [2^n, 2^(n+1)) microseconds from being queued to leaving the encoder.
+		static constexpr std::size_t latency_buckets = 24;
+
+		private:
+		std::map<int64_t, std::chrono::high_resolution_clock::time_point> _latency_start;
+		std::array<std::atomic<uint64_t>, latency_buckets>               _latency;
+
+#ifdef ENABLE_PROFILING
+		std::shared_ptr<streamfx::util::profiler> _profiler_copy;
+		std::shared_ptr<streamfx::util::profiler> _profiler_convert;
+		std::shared_ptr<streamfx::util::profiler> _profiler_encode;
+		std::shared_ptr<streamfx::util::profiler> _profiler_packet;
+#endif
 
 		public:
 		ffmpeg_instance(obs_data_t* settings, obs_encoder_t* self, bool is_hw);
@@ -87,6 +154,8 @@ namespace streamfx::encoder::ffmpeg {
 
 		bool update(obs_data_t* settings) override;
 
+		void request_keyframe() override;
+
 		bool encode_audio(struct encoder_frame* frame, struct encoder_packet* packet, bool* received_packet) override;
 
 		bool encode_video(struct encoder_frame* frame, struct encoder_packet* packet, bool* received_packet) override;
@@ -100,6 +169,8 @@ namespace streamfx::encoder::ffmpeg {
 
 		void get_video_info(struct video_scale_info* info) override;
 
+		bool get_statistics(streamfx_encoder_statistics* statistics) override;
+
 		public:
 		void initialize_sw(obs_data_t* settings);
 		void initialize_hw(obs_data_t* settings);
@@ -110,12 +181,47 @@ namespace streamfx::encoder::ffmpeg {
 		void                     push_used_frame(std::shared_ptr<AVFrame> frame);
 		std::shared_ptr<AVFrame> pop_used_frame();
 
-		int receive_packet(bool* received_packet, struct encoder_packet* packet);
+		int receive_packet(std::shared_ptr<AVPacket>& packet);
 
 		int send_frame(std::shared_ptr<AVFrame> frame);
 
-		bool encode_avframe(std::shared_ptr<AVFrame> frame, struct encoder_packet* packet, bool* received_packet);
+		bool encode_avframe(std::shared_ptr<AVFrame> frame, struct encoder_packet* packet, bool* received_packet,
+							struct encoder_frame* source = nullptr);
+
+		void get_latency_histogram(std::array<uint64_t, latency_buckets>& buckets);
+
+		frame_pool_usage get_frame_pool_usage();
+
+		void get_graphics_wait(uint64_t& waits, std::chrono::nanoseconds& time);
+
+		private:
+		std::shared_ptr<AVFrame> wrap_frame(struct encoder_frame* frame);
+
+		bool convert_frame(struct encoder_frame* frame, AVFrame* vframe);
+
+		bool apply_rate_control(const rate_control& rc);
 
+		static void zero_copy_free(void* opaque, uint8_t* data);
+
+		void release_zero_copy(AVFrame* queued, struct encoder_frame* source);
+
+		void trim_free_frames();
+
+		std::shared_ptr<AVPacket> pop_free_packet();
+
+		void push_free_packet(AVPacket* packet);
+
+		std::unique_ptr<::streamfx::obs::gs::context> enter_graphics();
+
+		void encode_main();
+
+		int encode_drain(std::vector<std::shared_ptr<AVPacket>>& packets);
+
+		void queue_packets(std::vector<std::shared_ptr<AVPacket>>& packets);
+
+		void build_packet(std::shared_ptr<AVPacket> av_packet, struct encoder_packet* packet);
+
+		public:
 		public: // Handler API
 		bool is_hardware_encode();
 
@@ -124,6 +230,9 @@ namespace streamfx::encoder::ffmpeg {
 		const AVCodecContext* get_avcodeccontext();
 
 		void parse_ffmpeg_commandline(std::string text);
+
+		/** Apply FFmpeg command line style options, such as "-b=6M -bufsize=12M", to the given context. */
+		void parse_ffmpeg_commandline(AVCodecContext* context, std::string text);
 	};
 
 	class ffmpeg_factory : public obs::encoder_factory<ffmpeg_factory, ffmpeg_instance> {
@@ -161,6 +270,7 @@ namespace streamfx::encoder::ffmpeg {
 		std::map<const AVCodec*, std::shared_ptr<ffmpeg_factory>> _factories;
 		std::map<std::string, std::shared_ptr<handler::handler>>  _handlers;
 		std::shared_ptr<handler::handler>                         _debug_handler;
+		std::shared_ptr<::streamfx::ffmpeg::avframe_cache>        _conversion_cache;
 
 		public:
 		ffmpeg_manager();
@@ -174,6 +284,8 @@ namespace streamfx::encoder::ffmpeg {
 
 		bool has_handler(std::string codec);
 
+		std::shared_ptr<::streamfx::ffmpeg::avframe_cache> get_conversion_cache();
+
 		public: // Singleton
 		static void initialize();
 
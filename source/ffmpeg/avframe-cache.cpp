@@ -0,0 +1,212 @@
+// FFMPEG Video Encoder Integration for OBS Studio
+// Copyright (c) 2019 Michael Fabian Dirks <info@xaymar.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "avframe-cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "tools.hpp"
+
+// Converted frames kept around after their last use, to be converted into again.
+#define ST_CACHE_SPARE_FRAMES 32
+
+// Entries tracked at most, anything older is dropped regardless of its lifetime.
+#define ST_CACHE_ENTRIES 8
+
+using namespace streamfx::ffmpeg;
+
+static bool is_same_target(const avframe_cache::key& lhs, const avframe_cache::key& rhs)
+{
+	return (lhs.width == rhs.width) && (lhs.height == rhs.height) && (lhs.format == rhs.format)
+		   && (lhs.colorspace == rhs.colorspace) && (lhs.range == rhs.range);
+}
+
+bool avframe_cache::key::operator==(const key& rhs) const
+{
+	return (source == rhs.source) && (source_format == rhs.source_format) && is_same_target(*this, rhs);
+}
+
+avframe_cache::avframe_cache() : _lock(), _entries(), _spare(), _interest(), _conversions(0), _shared(0) {}
+
+avframe_cache::~avframe_cache()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	_entries.clear();
+	_spare.clear();
+}
+
+std::shared_ptr<AVFrame> avframe_cache::create_frame(const key& id)
+{
+	// Reuse a spare frame if no consumer holds on to its buffers anymore.
+	for (auto itr = _spare.begin(); itr != _spare.end(); itr++) {
+		AVFrame* frame = itr->get();
+		if ((frame->width == id.width) && (frame->height == id.height) && (frame->format == id.format)
+			&& av_frame_is_writable(frame)) {
+			auto result = *itr;
+			_spare.erase(itr);
+			return result;
+		}
+	}
+
+	std::shared_ptr<AVFrame> frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame) {
+		av_frame_unref(frame);
+		av_frame_free(&frame);
+	});
+	frame->width                   = id.width;
+	frame->height                  = id.height;
+	frame->format                  = id.format;
+
+	int res = av_frame_get_buffer(frame.get(), 32);
+	if (res < 0) {
+		throw std::runtime_error(tools::get_error_description(res));
+	}
+
+	return frame;
+}
+
+std::shared_ptr<AVFrame> avframe_cache::reference(const std::shared_ptr<AVFrame>& frame)
+{
+	if (!frame) {
+		return nullptr;
+	}
+
+	std::shared_ptr<AVFrame> ref = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame) {
+		av_frame_unref(frame);
+		av_frame_free(&frame);
+	});
+	if (int res = av_frame_ref(ref.get(), frame.get()); res < 0) {
+		throw std::runtime_error(tools::get_error_description(res));
+	}
+	ref->opaque = this;
+	return ref;
+}
+
+void avframe_cache::subscribe(const key& id)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto& kv : _interest) {
+		if (is_same_target(kv.first, id)) {
+			kv.second++;
+			return;
+		}
+	}
+	_interest.emplace_back(id, 1);
+}
+
+void avframe_cache::unsubscribe(const key& id)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto itr = _interest.begin(); itr != _interest.end(); itr++) {
+		if (is_same_target(itr->first, id)) {
+			if (--itr->second == 0) {
+				_interest.erase(itr);
+			}
+			return;
+		}
+	}
+}
+
+bool avframe_cache::is_shared(const key& id)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto& kv : _interest) {
+		if (is_same_target(kv.first, id)) {
+			return kv.second > 1;
+		}
+	}
+	return false;
+}
+
+std::shared_ptr<AVFrame> avframe_cache::get(const key& id, const void* consumer, std::chrono::nanoseconds lifetime,
+											std::function<bool(AVFrame*)> convert)
+{
+	std::unique_lock<std::mutex> lock(_lock);
+
+	// Drop expired entries, keeping their frames for reuse.
+	auto now    = std::chrono::steady_clock::now();
+	auto retire = [this](std::list<entry>::iterator itr) {
+		if (itr->frame.valid()
+			&& (itr->frame.wait_for(std::chrono::seconds(0)) == std::future_status::ready) && itr->frame.get()
+			&& (_spare.size() < ST_CACHE_SPARE_FRAMES)) {
+			_spare.push_back(itr->frame.get());
+		}
+		return _entries.erase(itr);
+	};
+	for (auto itr = _entries.begin(); itr != _entries.end();) {
+		if ((itr->expires <= now) || (_entries.size() > ST_CACHE_ENTRIES)) {
+			itr = retire(itr);
+		} else {
+			itr++;
+		}
+	}
+
+	for (auto itr = _entries.begin(); itr != _entries.end(); itr++) {
+		if (!(itr->id == id)) {
+			continue;
+		}
+
+		// Asking twice for the same planes means OBS reused them for a new frame.
+		if (std::find(itr->consumers.begin(), itr->consumers.end(), consumer) != itr->consumers.end()) {
+			retire(itr);
+			break;
+		}
+
+		itr->consumers.push_back(consumer);
+		auto frame = itr->frame;
+		_shared++;
+		lock.unlock();
+
+		// Wait for the first consumer to finish converting, if it hasn't already.
+		return reference(frame.get());
+	}
+
+	// Nobody converted this yet, so it's on us.
+	std::promise<std::shared_ptr<AVFrame>> promise;
+	entry                                  ent;
+	ent.id      = id;
+	ent.expires = now + lifetime;
+	ent.consumers.push_back(consumer);
+	ent.frame = promise.get_future().share();
+	_entries.push_back(ent);
+	_conversions++;
+
+	// Anyone else waiting on this entry must be released, no matter how the conversion ends.
+	std::shared_ptr<AVFrame> frame;
+	try {
+		frame = create_frame(id);
+		lock.unlock();
+
+		if (!convert(frame.get())) {
+			frame.reset();
+		}
+	} catch (...) {
+		promise.set_value(nullptr);
+		throw;
+	}
+	promise.set_value(frame);
+
+	return reference(frame);
+}
+
+avframe_cache::statistics avframe_cache::get_statistics()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	return {_conversions, _shared};
+}
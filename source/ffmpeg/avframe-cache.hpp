@@ -0,0 +1,119 @@
+// FFMPEG Video Encoder Integration for OBS Studio
+// Copyright (c) 2019 Michael Fabian Dirks <info@xaymar.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "common.hpp"
+#include <array>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4242 4244 4365)
+#endif
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
+namespace streamfx::ffmpeg {
+	/** Shares converted frames between encoders that are fed the same OBS frame.
+	 *
+	 * The first consumer to ask for a key converts the frame, everyone else asking for the same key receives a new
+	 * reference to the same buffers instead of converting again. Frames handed out are read-only and carry the cache
+	 * in their opaque field, so they can be told apart from pooled frames.
+	 */
+	class avframe_cache {
+		public:
+		struct key {
+			// OBS hands the same frame to every encoder, so its planes identify it. The pts can't be used, as every
+			// encoder counts its own from the moment it was started.
+			std::array<const uint8_t*, AV_NUM_DATA_POINTERS> source;
+			AVPixelFormat                                    source_format;
+
+			int32_t       width;
+			int32_t       height;
+			AVPixelFormat format;
+			AVColorSpace  colorspace;
+			AVColorRange  range;
+
+			bool operator==(const key& rhs) const;
+		};
+
+		struct statistics {
+			uint64_t conversions; // Frames converted by the first consumer.
+			uint64_t shared;      // Frames handed to further consumers without converting.
+		};
+
+		private:
+		struct entry {
+			key                                          id;
+			std::chrono::steady_clock::time_point        expires;
+			std::vector<const void*>                     consumers;
+			std::shared_future<std::shared_ptr<AVFrame>> frame;
+		};
+
+		std::mutex                               _lock;
+		std::list<entry>                         _entries;
+		std::vector<std::shared_ptr<AVFrame>>    _spare;
+		std::vector<std::pair<key, std::size_t>> _interest;
+
+		uint64_t _conversions;
+		uint64_t _shared;
+
+		std::shared_ptr<AVFrame> create_frame(const key& id);
+
+		std::shared_ptr<AVFrame> reference(const std::shared_ptr<AVFrame>& frame);
+
+		public:
+		avframe_cache();
+		~avframe_cache();
+
+		/** Announce that a consumer will ask for frames with this key, ignoring the source fields.
+		 *
+		 * Caching only pays off once more than one consumer converts to the same target.
+		 */
+		void subscribe(const key& id);
+		void unsubscribe(const key& id);
+		bool is_shared(const key& id);
+
+		/** Retrieve the converted frame for the given key, converting it if nobody else has yet.
+		 *
+		 * @param id Source planes and conversion target.
+		 * @param consumer Unique identifier of the caller, a consumer asking for the same key twice means the source
+		 *                 planes were reused for a new frame.
+		 * @param lifetime How long other consumers may pick up the converted frame.
+		 * @param convert Called with an empty frame matching the target, must return false on failure.
+		 * @return A new reference to the converted frame, or nullptr if the conversion failed.
+		 */
+		std::shared_ptr<AVFrame> get(const key& id, const void* consumer, std::chrono::nanoseconds lifetime,
+									 std::function<bool(AVFrame*)> convert);
+
+		statistics get_statistics();
+	};
+} // namespace streamfx::ffmpeg
@@ -22,17 +22,32 @@
 #include "avframe-queue.hpp"
 #include "tools.hpp"
 
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4242 4244 4365)
+#endif
+#include <libavutil/imgutils.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
 using namespace streamfx::ffmpeg;
 
 std::shared_ptr<AVFrame> avframe_queue::create_frame()
 {
+	if (_allocator) {
+		return _allocator();
+	}
+
 	std::shared_ptr<AVFrame> frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame) {
 		av_frame_unref(frame);
 		av_frame_free(&frame);
 	});
-	frame->width                   = this->_resolution.first;
-	frame->height                  = this->_resolution.second;
-	frame->format                  = this->_format;
+	frame->width                   = _width.load(std::memory_order_relaxed);
+	frame->height                  = _height.load(std::memory_order_relaxed);
+	frame->format                  = _format.load(std::memory_order_relaxed);
 
 	int res = av_frame_get_buffer(frame.get(), 32);
 	if (res < 0) {
@@ -42,7 +57,17 @@ std::shared_ptr<AVFrame> avframe_queue::create_frame()
 	return frame;
 }
 
-avframe_queue::avframe_queue() {}
+avframe_queue::avframe_queue(std::size_t capacity)
+	: _frames(), _mask(0), _head(0), _tail(0), _width(0), _height(0), _format(AV_PIX_FMT_NONE), _allocator(), _hits(0),
+	  _misses(0), _reallocations(0), _rejected(0), _trimmed(0), _peak(0)
+{
+	std::size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	_frames.resize(size);
+	_mask = size - 1;
+}
 
 avframe_queue::~avframe_queue()
 {
@@ -51,99 +76,158 @@ avframe_queue::~avframe_queue()
 
 void avframe_queue::set_resolution(int32_t const width, int32_t const height)
 {
-	this->_resolution.first  = width;
-	this->_resolution.second = height;
+	_width.store(width, std::memory_order_relaxed);
+	_height.store(height, std::memory_order_relaxed);
 }
 
 void avframe_queue::get_resolution(int32_t& width, int32_t& height)
 {
-	width  = this->_resolution.first;
-	height = this->_resolution.second;
+	width  = _width.load(std::memory_order_relaxed);
+	height = _height.load(std::memory_order_relaxed);
 }
 
 int32_t avframe_queue::get_width()
 {
-	return this->_resolution.first;
+	return _width.load(std::memory_order_relaxed);
 }
 
 int32_t avframe_queue::get_height()
 {
-	return this->_resolution.second;
+	return _height.load(std::memory_order_relaxed);
 }
 
 void avframe_queue::set_pixel_format(AVPixelFormat const format)
 {
-	this->_format = format;
+	_format.store(format, std::memory_order_relaxed);
 }
 
 AVPixelFormat avframe_queue::get_pixel_format()
 {
-	return this->_format;
+	return static_cast<AVPixelFormat>(_format.load(std::memory_order_relaxed));
 }
 
-void avframe_queue::precache(std::size_t count)
+void avframe_queue::set_allocator(std::function<std::shared_ptr<AVFrame>()> allocator)
 {
-	for (std::size_t n = 0; n < count; n++) {
-		push(create_frame());
+	_allocator = allocator;
+}
+
+std::size_t avframe_queue::precache(std::size_t count)
+{
+	std::size_t allocated = 0;
+	for (count = std::min(count, capacity()); size() < count; allocated++) {
+		if (!push(create_frame())) {
+			break;
+		}
 	}
+	return allocated;
 }
 
-void avframe_queue::clear()
+bool avframe_queue::push(std::shared_ptr<AVFrame> const frame)
 {
-	std::unique_lock<std::mutex> ulock(this->_lock);
-	_frames.clear();
+	if (!frame) {
+		return false;
+	}
+
+	std::size_t tail = _tail.load(std::memory_order_relaxed);
+	if ((tail - _head.load(std::memory_order_acquire)) > _mask) {
+		_rejected.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	_frames[tail & _mask] = frame;
+	_tail.store(tail + 1, std::memory_order_release);
+
+	uint64_t size = tail + 1 - _head.load(std::memory_order_relaxed);
+	uint64_t peak = _peak.load(std::memory_order_relaxed);
+	while ((size > peak) && !_peak.compare_exchange_weak(peak, size, std::memory_order_relaxed)) {
+	}
+	return true;
 }
 
-void avframe_queue::push(std::shared_ptr<AVFrame> const frame)
+void avframe_queue::clear()
 {
-	std::unique_lock<std::mutex> ulock(this->_lock);
-	_frames.push_back(frame);
+	while (pop_only()) {
+	}
 }
 
 std::shared_ptr<AVFrame> avframe_queue::pop()
 {
-	std::unique_lock<std::mutex> ulock(this->_lock);
-	std::shared_ptr<AVFrame>     ret;
-	while (ret == nullptr) {
-		if (_frames.size() == 0) {
-			ret = create_frame();
-		} else {
-			ret = _frames.front();
-			if (ret == nullptr) {
-				ret = create_frame();
-			} else {
-				_frames.pop_front();
-				if ((static_cast<int32_t>(ret->width) != this->_resolution.first)
-					|| (static_cast<int32_t>(ret->height) != this->_resolution.second)
-					|| (ret->format != this->_format)) {
-					ret = nullptr;
-				}
-			}
+	if (auto frame = try_pop(); frame) {
+		return frame;
+	}
+
+	_misses.fetch_add(1, std::memory_order_relaxed);
+	return create_frame();
+}
+
+std::shared_ptr<AVFrame> avframe_queue::try_pop()
+{
+	while (auto frame = pop_only()) {
+		if ((frame->width == _width.load(std::memory_order_relaxed))
+			&& (frame->height == _height.load(std::memory_order_relaxed))
+			&& (frame->format == _format.load(std::memory_order_relaxed))) {
+			_hits.fetch_add(1, std::memory_order_relaxed);
+			return frame;
 		}
+
+		// Outdated frame, let it be freed and check the next one.
+		_reallocations.fetch_add(1, std::memory_order_relaxed);
 	}
-	return ret;
+
+	return nullptr;
 }
 
 std::shared_ptr<AVFrame> avframe_queue::pop_only()
 {
-	std::unique_lock<std::mutex> ulock(this->_lock);
-	if (_frames.size() == 0) {
+	std::size_t head = _head.load(std::memory_order_relaxed);
+	if (head == _tail.load(std::memory_order_acquire)) {
 		return nullptr;
 	}
-	std::shared_ptr<AVFrame> ret = _frames.front();
-	if (ret == nullptr) {
-		return nullptr;
+
+	std::shared_ptr<AVFrame> frame = std::move(_frames[head & _mask]);
+	_head.store(head + 1, std::memory_order_release);
+	return frame;
+}
+
+std::size_t avframe_queue::trim(std::size_t keep)
+{
+	std::size_t count = 0;
+	while (size() > keep) {
+		if (!pop_only()) {
+			break;
+		}
+		count++;
 	}
-	_frames.pop_front();
-	return ret;
+	_trimmed.fetch_add(count, std::memory_order_relaxed);
+	return count;
 }
 
 bool avframe_queue::empty()
 {
-	return _frames.empty();
+	return size() == 0;
 }
 
 std::size_t avframe_queue::size()
+{
+	std::size_t head = _head.load(std::memory_order_acquire);
+	std::size_t tail = _tail.load(std::memory_order_acquire);
+	return (tail >= head) ? (tail - head) : 0;
+}
+
+std::size_t avframe_queue::capacity()
 {
 	return _frames.size();
 }
+
+std::size_t avframe_queue::frame_size()
+{
+	int size = av_image_get_buffer_size(get_pixel_format(), get_width(), get_height(), 32);
+	return (size > 0) ? static_cast<std::size_t>(size) : 0;
+}
+
+avframe_queue::statistics avframe_queue::get_statistics()
+{
+	return {_hits.load(std::memory_order_relaxed), _misses.load(std::memory_order_relaxed),
+			_reallocations.load(std::memory_order_relaxed), _rejected.load(std::memory_order_relaxed),
+			_trimmed.load(std::memory_order_relaxed), _peak.load(std::memory_order_relaxed)};
+}
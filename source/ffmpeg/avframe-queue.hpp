@@ -21,8 +21,9 @@
 
 #pragma once
 #include "common.hpp"
-#include <deque>
-#include <mutex>
+#include <atomic>
+#include <functional>
+#include <vector>
 
 extern "C" {
 #ifdef _MSC_VER
@@ -36,17 +37,50 @@ extern "C" {
 }
 
 namespace streamfx::ffmpeg {
+	/** Bounded single-producer single-consumer ring of reusable frames.
+	 *
+	 * One thread may push() and precache() while another thread pop()s, try_pop()s and clear()s, without any locks.
+	 * When the ring is full, push() refuses the frame, which is then released by the caller dropping its reference.
+	 */
 	class avframe_queue {
-		std::deque<std::shared_ptr<AVFrame>> _frames;
-		std::mutex                           _lock;
+		public:
+		struct statistics {
+			uint64_t hits;          // pop() or try_pop() reused a pooled frame.
+			uint64_t misses;        // pop() found the pool empty and allocated a new frame.
+			uint64_t reallocations; // pop() or try_pop() discarded a pooled frame with outdated resolution or format.
+			uint64_t rejected;      // push() found the pool full and dropped the frame.
+			uint64_t trimmed;       // trim() released an idle frame.
+			uint64_t peak;          // Most frames pooled at once.
+		};
+
+		private:
+		std::vector<std::shared_ptr<AVFrame>> _frames;
+		std::size_t                           _mask;
+
+		alignas(64) std::atomic<std::size_t> _head; // Next slot to pop, owned by the consumer.
+		alignas(64) std::atomic<std::size_t> _tail; // Next slot to push, owned by the producer.
+
+		std::atomic<int32_t> _width;
+		std::atomic<int32_t> _height;
+		std::atomic<int32_t> _format;
 
-		std::pair<int32_t, int32_t> _resolution;
-		AVPixelFormat               _format = AV_PIX_FMT_NONE;
+		std::function<std::shared_ptr<AVFrame>()> _allocator;
+
+		std::atomic<uint64_t> _hits;
+		std::atomic<uint64_t> _misses;
+		std::atomic<uint64_t> _reallocations;
+		std::atomic<uint64_t> _rejected;
+		std::atomic<uint64_t> _trimmed;
+		std::atomic<uint64_t> _peak;
 
 		std::shared_ptr<AVFrame> create_frame();
 
 		public:
-		avframe_queue();
+		/** Create a new queue.
+		 *
+		 * @param capacity Maximum number of pooled frames, rounded up to the next power of two.
+		 */
+		avframe_queue(std::size_t capacity = 16);
 		~avframe_queue();
 
 		void    set_resolution(int32_t width, int32_t height);
@@ -57,18 +91,55 @@ namespace streamfx::ffmpeg {
 		void          set_pixel_format(AVPixelFormat format);
 		AVPixelFormat get_pixel_format();
 
-		void precache(std::size_t count);
+		/** Replace the default av_frame_get_buffer() allocation, for example with hardware frames.
+		 *
+		 * Must be called before the queue is used from multiple threads.
+		 */
+		void set_allocator(std::function<std::shared_ptr<AVFrame>()> allocator);
 
-		void clear();
+		// Producer
+		/** Allocate frames at the current resolution and format until 'count' are pooled, or the pool is full.
+		 *
+		 * @return Number of frames allocated.
+		 */
+		std::size_t precache(std::size_t count);
 
-		void push(std::shared_ptr<AVFrame> frame);
+		/** Return a frame to the pool.
+		 *
+		 * @return false if the pool is full, in which case the frame is released once the caller lets go of it.
+		 */
+		bool push(std::shared_ptr<AVFrame> frame);
 
+		// Consumer
+		void clear();
+
+		/** Take a pooled frame matching the current resolution and format, allocating a new one if there is none. */
 		std::shared_ptr<AVFrame> pop();
 
+		/** Take a pooled frame matching the current resolution and format, without ever allocating.
+		 *
+		 * @return nullptr if the pool holds no such frame.
+		 */
+		std::shared_ptr<AVFrame> try_pop();
+
 		std::shared_ptr<AVFrame> pop_only();
 
+		/** Release pooled frames until at most 'keep' remain.
+		 *
+		 * @return Number of frames released.
+		 */
+		std::size_t trim(std::size_t keep);
+
+		// Any thread
 		bool empty();
 
 		std::size_t size();
+
+		std::size_t capacity();
+
+		/** Approximate size of a single frame at the current resolution and format, in bytes. */
+		std::size_t frame_size();
+
+		statistics get_statistics();
 	};
 } // namespace streamfx::ffmpeg
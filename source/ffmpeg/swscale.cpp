@@ -20,7 +20,24 @@
 // SOFTWARE.
 
 #include "swscale.hpp"
+#include <atomic>
 #include <stdexcept>
+#include <thread>
+#include "plugin.hpp"
+
+extern "C" {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4242 4244 4365)
+#endif
+#include <libavutil/pixdesc.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
+// Automatic slicing aims for roughly this many rows per slice.
+#define ST_SLICE_ROWS 540
 
 using namespace streamfx::ffmpeg;
 
@@ -157,6 +174,23 @@ bool swscale::is_target_full_range()
 	return this->target_full_range;
 }
 
+void swscale::set_slices(uint32_t count)
+{
+	if (count == 0) {
+		count = std::max<uint32_t>(source_size.second / ST_SLICE_ROWS, 1);
+		count = std::min<uint32_t>(count, std::max<uint32_t>(std::thread::hardware_concurrency(), 1));
+	}
+	slice_count = count;
+}
+
+uint32_t swscale::get_slices()
+{
+	if (this->context) {
+		return std::max<uint32_t>(static_cast<uint32_t>(slices.size()), 1);
+	}
+	return slice_count;
+}
+
 bool swscale::initialize(int flags)
 {
 	if (this->context) {
@@ -183,11 +217,53 @@ bool swscale::initialize(int flags)
 							 sws_getCoefficients(target_colorspace), target_full_range ? 1 : 0, 1L << 16 | 0L,
 							 1L << 16 | 0L, 1L << 16 | 0L);
 
+	// Each slice is converted independently, so no output row may depend on a source row of another slice. That rules
+	// out scaling, and also resampling chroma vertically, which filters across neighbouring rows.
+	int src_h_shift, src_v_shift, tgt_h_shift, tgt_v_shift;
+	av_pix_fmt_get_chroma_sub_sample(source_format, &src_h_shift, &src_v_shift);
+	av_pix_fmt_get_chroma_sub_sample(target_format, &tgt_h_shift, &tgt_v_shift);
+	if ((slice_count > 1) && (source_size == target_size) && (src_v_shift == tgt_v_shift)) {
+		// Slices start on a multiple of 8 rows in every plane. Ordered dithering, used when reducing bit depth,
+		// repeats every 8 rows counted from the start of the slice, so this keeps its pattern seamless.
+		int32_t align  = 8 << src_v_shift;
+		int32_t height = static_cast<int32_t>(source_size.second);
+		int32_t rows   = (height + static_cast<int32_t>(slice_count) - 1) / static_cast<int32_t>(slice_count);
+		rows           = ((rows + align - 1) / align) * align;
+
+		for (int32_t row = 0; row < height; row += rows) {
+			slice sl;
+			sl.row     = row;
+			sl.rows    = std::min(rows, height - row);
+			sl.context = sws_getContext(static_cast<int>(source_size.first), sl.rows, source_format,
+										static_cast<int>(target_size.first), sl.rows, target_format, flags, nullptr,
+										nullptr, nullptr);
+			if (!sl.context) {
+				finalize();
+				return false;
+			}
+			sws_setColorspaceDetails(sl.context, sws_getCoefficients(source_colorspace), source_full_range ? 1 : 0,
+									 sws_getCoefficients(target_colorspace), target_full_range ? 1 : 0, 1L << 16 | 0L,
+									 1L << 16 | 0L, 1L << 16 | 0L);
+			slices.push_back(sl);
+		}
+
+		// Not worth it if it ended up being a single slice.
+		if (slices.size() == 1) {
+			sws_freeContext(slices.front().context);
+			slices.clear();
+		}
+	}
+
 	return true;
 }
 
 bool swscale::finalize()
 {
+	for (auto& sl : slices) {
+		sws_freeContext(sl.context);
+	}
+	slices.clear();
+
 	if (this->context) {
 		sws_freeContext(this->context);
 		this->context = nullptr;
@@ -202,7 +278,49 @@ int32_t swscale::convert(const uint8_t* const source_data[], const int source_st
 	if (!this->context) {
 		return 0;
 	}
-	int height =
-		sws_scale(this->context, source_data, source_stride, source_row, source_rows, target_data, target_stride);
-	return height;
+
+	// Full frames are converted slice by slice in parallel, anything else goes through the single context.
+	auto pool = streamfx::threadpool();
+	if (slices.empty() || !pool || (source_row != 0) || (source_rows != static_cast<int32_t>(source_size.second))) {
+		return sws_scale(this->context, source_data, source_stride, source_row, source_rows, target_data,
+						 target_stride);
+	}
+
+	int src_h_shift, src_v_shift, tgt_h_shift, tgt_v_shift;
+	av_pix_fmt_get_chroma_sub_sample(source_format, &src_h_shift, &src_v_shift);
+	av_pix_fmt_get_chroma_sub_sample(target_format, &tgt_h_shift, &tgt_v_shift);
+	int src_planes = av_pix_fmt_count_planes(source_format);
+	int tgt_planes = av_pix_fmt_count_planes(target_format);
+
+	std::atomic<int32_t> converted{0};
+
+	auto convert_slice = [&](const slice& sl) {
+		const uint8_t* src[4] = {nullptr, nullptr, nullptr, nullptr};
+		uint8_t*       tgt[4] = {nullptr, nullptr, nullptr, nullptr};
+		for (int idx = 0; idx < src_planes; idx++) {
+			// Plane 0 and 3 (alpha) are never subsampled.
+			int32_t row = ((idx == 1) || (idx == 2)) ? (sl.row >> src_v_shift) : sl.row;
+			src[idx]    = source_data[idx] + static_cast<ptrdiff_t>(row) * source_stride[idx];
+		}
+		for (int idx = 0; idx < tgt_planes; idx++) {
+			int32_t row = ((idx == 1) || (idx == 2)) ? (sl.row >> tgt_v_shift) : sl.row;
+			tgt[idx]    = target_data[idx] + static_cast<ptrdiff_t>(row) * target_stride[idx];
+		}
+		int res = sws_scale(sl.context, src, source_stride, 0, sl.rows, tgt, target_stride);
+		if (res > 0) {
+			converted.fetch_add(res);
+		}
+	};
+
+	// Hand all but the first slice to the pool, and convert that one ourselves.
+	streamfx::util::threadpool::task_group group;
+	for (std::size_t idx = 1; idx < slices.size(); idx++) {
+		const slice& sl = slices[idx];
+		group.add(pool->push([&convert_slice, &sl](streamfx::util::threadpool_data_t) { convert_slice(sl); }, nullptr,
+							 streamfx::util::threadpool::priority::REALTIME));
+	}
+	convert_slice(slices.front());
+	group.wait();
+
+	return converted.load();
 }
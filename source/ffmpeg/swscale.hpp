@@ -22,6 +22,7 @@
 #pragma once
 #include "common.hpp"
 #include <utility>
+#include <vector>
 
 extern "C" {
 #ifdef _MSC_VER
@@ -49,6 +50,15 @@ namespace streamfx::ffmpeg {
 
 		SwsContext* context = nullptr;
 
+		// Horizontal slices converted in parallel, each with its own context.
+		struct slice {
+			SwsContext* context;
+			int32_t     row;
+			int32_t     rows;
+		};
+		uint32_t           slice_count = 1;
+		std::vector<slice> slices;
+
 		public:
 		swscale();
 		~swscale();
@@ -79,6 +89,15 @@ namespace streamfx::ffmpeg {
 		void                          set_target_full_range(bool full_range);
 		bool                          is_target_full_range();
 
+		/** Split conversions into this many horizontal slices, converted in parallel on the thread pool.
+		 *
+		 * Only applies to conversions without scaling or vertical chroma resampling, where the result is identical to
+		 * converting the frame as a whole. Must be set before initialize(), 0 picks a count based on the frame height.
+		 * Once initialized, get_slices() returns the number of slices actually in use.
+		 */
+		void     set_slices(uint32_t count);
+		uint32_t get_slices();
+
 		bool initialize(int flags);
 		bool finalize();
 
@@ -148,16 +148,16 @@ autoframing_instance::~autoframing_instance()
 {
 	D_LOG_DEBUG("Finalizing... (Addr: 0x%" PRIuPTR ")", this);
 
+	// De-queue the underlying task, or await it if it is already running. It takes the provider lock itself.
+	if (_provider_task) {
+		streamfx::threadpool()->pop(_provider_task);
+		_provider_task->await_completion();
+		_provider_task.reset();
+	}
+
 	{ // Unload the underlying effect ASAP.
 		std::unique_lock<std::mutex> ul(_provider_lock);
 
-		// De-queue the underlying task.
-		if (_provider_task) {
-			streamfx::threadpool()->pop(_provider_task);
-			_provider_task->await_completion();
-			_provider_task.reset();
-		}
-
 		// TODO: Make this asynchronous.
 		switch (_provider) {
 #ifdef ENABLE_FILTER_DENOISING_NVIDIA
@@ -856,33 +856,30 @@ struct switch_provider_data_t {
 
 void streamfx::filter::autoframing::autoframing_instance::switch_provider(tracking_provider provider)
 {
-	std::unique_lock<std::mutex> ul(_provider_lock);
+	{ // Safeguard against calls made from unlocked memory.
+		std::unique_lock<std::mutex> ul(_provider_lock);
+		if (provider == _provider) {
+			return;
+		}
+	}
 
-	// Safeguard against calls made from unlocked memory.
-	if (provider == _provider) {
-		return;
+	// If there is an existing task, de-queue it or await its death if it is already running. It takes the provider
+	// lock itself, so it must not be held while waiting.
+	if (_provider_task) {
+		streamfx::threadpool()->pop(_provider_task);
+		_provider_task->await_completion();
+		_provider_task.reset();
 	}
 
+	std::unique_lock<std::mutex> ul(_provider_lock);
+
 	// This doesn't work correctly.
 	// - Need to allow multiple switches at once because OBS is weird.
-	// - Doesn't guarantee that the task is properly killed off.
 
 	// Log information.
 	D_LOG_INFO("Instance '%s' is switching provider from '%s' to '%s'.", obs_source_get_name(_self), cstring(_provider),
 			   cstring(provider));
 
-	// If there is an ongoing task to switch provider, cancel it.
-	if (_provider_task) {
-		// De-queue it.
-		streamfx::threadpool()->pop(_provider_task);
-
-		// Await the death of the task itself.
-		_provider_task->await_completion();
-
-		// Clear any memory associated with it.
-		_provider_task.reset();
-	}
-
 	// Build data to pass into the task.
 	auto spd      = std::make_shared<switch_provider_data_t>();
 	spd->provider = _provider;
@@ -890,7 +887,8 @@ void streamfx::filter::autoframing::autoframing_instance::switch_provider(tracki
 
 	// Then spawn a new task to switch provider.
 	_provider_task = streamfx::threadpool()->push(
-		std::bind(&autoframing_instance::task_switch_provider, this, std::placeholders::_1), spd);
+		std::bind(&autoframing_instance::task_switch_provider, this, std::placeholders::_1), spd,
+		util::threadpool::priority::BACKGROUND);
 }
 
 void streamfx::filter::autoframing::autoframing_instance::task_switch_provider(util::threadpool_data_t data)
@@ -87,7 +87,7 @@ std::string streamfx::filter::denoising::string(denoising_provider provider)
 denoising_instance::denoising_instance(obs_data_t* data, obs_source_t* self)
 	: obs::source_instance(data, self),
 
-	  _size(1, 1), _provider_ready(false), _provider(denoising_provider::INVALID), _provider_lock(), _provider_task(),
+	  _size(1, 1), _provider_ready(false), _provider(denoising_provider::INVALID), _provider_lock(), _provider_tasks(),
 	  _input(), _output()
 {
 	D_LOG_DEBUG("Initializating... (Addr: 0x%" PRIuPTR ")", this);
@@ -124,16 +124,13 @@ denoising_instance::~denoising_instance()
 {
 	D_LOG_DEBUG("Finalizing... (Addr: 0x%" PRIuPTR ")", this);
 
+	// De-queue the underlying tasks, and await those already running. They take the provider lock themselves.
+	_provider_tasks.cancel();
+	_provider_tasks.wait();
+
 	{ // Unload the underlying effect ASAP.
 		std::unique_lock<std::mutex> ul(_provider_lock);
 
-		// De-queue the underlying task.
-		if (_provider_task) {
-			streamfx::threadpool()->pop(_provider_task);
-			_provider_task->await_completion();
-			_provider_task.reset();
-		}
-
 		// TODO: Make this asynchronous.
 		switch (_provider) {
 #ifdef ENABLE_FILTER_DENOISING_NVIDIA
@@ -369,41 +366,38 @@ struct switch_provider_data_t {
 
 void streamfx::filter::denoising::denoising_instance::switch_provider(denoising_provider provider)
 {
-	std::unique_lock<std::mutex> ul(_provider_lock);
-
-	// Safeguard against calls made from unlocked memory.
-	if (provider == _provider) {
-		return;
+	{ // Safeguard against calls made from unlocked memory.
+		std::unique_lock<std::mutex> ul(_provider_lock);
+		if (provider == _provider) {
+			return;
+		}
 	}
 
+	// If there are existing tasks, cancel those that have not started and await the death of the rest. They take the
+	// provider lock themselves, so it must not be held while waiting.
+	_provider_tasks.cancel();
+	_provider_tasks.wait();
+
+	std::unique_lock<std::mutex> ul(_provider_lock);
+
 	// This doesn't work correctly.
 	// - Need to allow multiple switches at once because OBS is weird.
-	// - Doesn't guarantee that the task is properly killed off.
 
 	// Log information.
 	D_LOG_INFO("Instance '%s' is switching provider from '%s' to '%s'.", obs_source_get_name(_self), cstring(_provider),
 			   cstring(provider));
 
-	// If there is an existing task, attempt to cancel it.
-	if (_provider_task) {
-		// De-queue it.
-		streamfx::threadpool()->pop(_provider_task);
-
-		// Await the death of the task itself.
-		_provider_task->await_completion();
-
-		// Clear any memory associated with it.
-		_provider_task.reset();
-	}
-
 	// Build data to pass into the task.
 	auto spd      = std::make_shared<switch_provider_data_t>();
 	spd->provider = _provider;
 	_provider     = provider;
 
-	// Then spawn a new task to switch provider.
-	_provider_task = streamfx::threadpool()->push(
-		std::bind(&denoising_instance::task_switch_provider, this, std::placeholders::_1), spd);
+	// Then spawn a new task to switch provider, followed by one to apply the current size to it.
+	auto task = streamfx::threadpool()->push(
+		std::bind(&denoising_instance::task_switch_provider, this, std::placeholders::_1), spd,
+		util::threadpool::priority::BACKGROUND);
+	_provider_tasks.add(task);
+	_provider_tasks.add(task->then(std::bind(&denoising_instance::task_size_provider, this, std::placeholders::_1)));
 }
 
 void streamfx::filter::denoising::denoising_instance::task_switch_provider(util::threadpool_data_t data)
@@ -450,6 +444,24 @@ void streamfx::filter::denoising::denoising_instance::task_switch_provider(util:
 	}
 }
 
+void streamfx::filter::denoising::denoising_instance::task_size_provider(util::threadpool_data_t)
+{
+	if (!_provider_ready) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> ul(_provider_lock);
+	switch (_provider) {
+#ifdef ENABLE_FILTER_DENOISING_NVIDIA
+	case denoising_provider::NVIDIA_DENOISING:
+		nvvfx_denoising_size();
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
 #ifdef ENABLE_FILTER_DENOISING_NVIDIA
 void streamfx::filter::denoising::denoising_instance::nvvfx_denoising_load()
 {
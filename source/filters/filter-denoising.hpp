@@ -51,7 +51,7 @@ namespace streamfx::filter::denoising {
 		denoising_provider                      _provider_ui;
 		std::atomic<bool>                       _provider_ready;
 		std::mutex                              _provider_lock;
-		std::shared_ptr<util::threadpool::task> _provider_task;
+		util::threadpool::task_group            _provider_tasks;
 
 		std::shared_ptr<::streamfx::obs::gs::effect>  _standard_effect;
 		std::shared_ptr<::streamfx::obs::gs::sampler> _channel0_sampler;
@@ -83,6 +83,7 @@ namespace streamfx::filter::denoising {
 		private:
 		void switch_provider(denoising_provider provider);
 		void task_switch_provider(util::threadpool_data_t data);
+		void task_size_provider(util::threadpool_data_t data);
 
 #ifdef ENABLE_FILTER_DENOISING_NVIDIA
 		void nvvfx_denoising_load();
@@ -52,7 +52,7 @@ namespace streamfx::filter::upscaling {
 		upscaling_provider                      _provider_ui;
 		std::atomic<bool>                       _provider_ready;
 		std::mutex                              _provider_lock;
-		std::shared_ptr<util::threadpool::task> _provider_task;
+		util::threadpool::task_group            _provider_tasks;
 
 		std::shared_ptr<::streamfx::obs::gs::effect>  _standard_effect;
 		std::shared_ptr<::streamfx::obs::gs::sampler> _channel0_sampler;
@@ -84,6 +84,7 @@ namespace streamfx::filter::upscaling {
 		private:
 		void switch_provider(upscaling_provider provider);
 		void task_switch_provider(util::threadpool_data_t data);
+		void task_size_provider(util::threadpool_data_t data);
 
 #ifdef ENABLE_FILTER_UPSCALING_NVIDIA
 		void nvvfxsr_load();
@@ -18,3 +18,59 @@
  */
 
 #include "obs-encoder-factory.hpp"
+#include <map>
+#include <mutex>
+
+static std::mutex                                                 _instances_lock;
+static std::map<obs_encoder_t*, streamfx::obs::encoder_instance*> _instances;
+
+void streamfx::obs::track_encoder_instance(obs_encoder_t* encoder, encoder_instance* instance)
+{
+	if (!instance) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_instances_lock);
+	_instances[encoder] = instance;
+}
+
+void streamfx::obs::untrack_encoder_instance(obs_encoder_t* encoder)
+{
+	std::lock_guard<std::mutex> lock(_instances_lock);
+	_instances.erase(encoder);
+}
+
+#ifdef ENABLE_PROFILING
+void streamfx::obs::encoder_instance::fill_stage(streamfx_encoder_stage&                   stage,
+												 std::shared_ptr<streamfx::util::profiler> profiler)
+{
+	auto summary = profiler->summary();
+	stage.count  = summary.count;
+	stage.total  = static_cast<uint64_t>(summary.total.count());
+	stage.p50    = static_cast<uint64_t>(summary.p50.count());
+	stage.p90    = static_cast<uint64_t>(summary.p90.count());
+	stage.p99    = static_cast<uint64_t>(summary.p99.count());
+	stage.p999   = static_cast<uint64_t>(summary.p999.count());
+}
+#endif
+
+MODULE_EXPORT bool streamfx_encoder_get_statistics(obs_encoder_t* encoder, streamfx_encoder_statistics* statistics)
+try {
+	if (!encoder || !statistics) {
+		return false;
+	}
+	*statistics = {};
+
+	// Hold the lock while asking, as the instance can't be destroyed before it is untracked.
+	std::lock_guard<std::mutex> lock(_instances_lock);
+	if (auto kv = _instances.find(encoder); kv != _instances.end()) {
+		return kv->second->get_statistics(statistics);
+	}
+	return false;
+} catch (const std::exception& ex) {
+	DLOG_ERROR("Unexpected exception in function '%s': %s.", __FUNCTION_NAME__, ex.what());
+	return false;
+} catch (...) {
+	DLOG_ERROR("Unexpected exception in function '%s'.", __FUNCTION_NAME__);
+	return false;
+}
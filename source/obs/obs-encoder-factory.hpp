@@ -20,14 +20,24 @@
 #pragma once
 #include "common.hpp"
 #include "plugin.hpp"
+#include "obs-encoder-statistics.hpp"
+
+#ifdef ENABLE_PROFILING
+#include "util/util-profiler.hpp"
+#endif
 
 namespace streamfx::obs {
 	class encoder_instance {
 		protected:
 		obs_encoder_t* _self;
 
+		private:
+		int64_t _keyframe_request;
+
 		public:
-		encoder_instance(obs_data_t* settings, obs_encoder_t* self, bool is_hw) : _self(self) {}
+		encoder_instance(obs_data_t* settings, obs_encoder_t* self, bool is_hw)
+			: _self(self), _keyframe_request(obs_data_get_int(settings, S_KEYFRAME_REQUEST))
+		{}
 		virtual ~encoder_instance(){};
 
 		virtual void migrate(obs_data_t* settings, uint64_t version) {}
@@ -37,6 +47,27 @@ namespace streamfx::obs {
 			return false;
 		}
 
+		/** Make the next frame a key frame. */
+		virtual void request_keyframe() {}
+
+		/** Fill in what the encoder tracked so far, see obs-encoder-statistics.hpp.
+		 *
+		 * @return false if the encoder tracks nothing.
+		 */
+		virtual bool get_statistics(streamfx_encoder_statistics* statistics)
+		{
+			return false;
+		}
+
+		/** Request a key frame if S_KEYFRAME_REQUEST changed since the last time settings were applied. */
+		void update_keyframe_request(obs_data_t* settings)
+		{
+			if (int64_t request = obs_data_get_int(settings, S_KEYFRAME_REQUEST); request != _keyframe_request) {
+				_keyframe_request = request;
+				request_keyframe();
+			}
+		}
+
 		virtual bool encode(struct encoder_frame* frame, struct encoder_packet* packet, bool* received_packet)
 		{
 			auto type = obs_encoder_get_type(_self);
@@ -87,8 +118,17 @@ namespace streamfx::obs {
 		{
 			return _self;
 		}
+
+#ifdef ENABLE_PROFILING
+		protected:
+		static void fill_stage(streamfx_encoder_stage& stage, std::shared_ptr<streamfx::util::profiler> profiler);
+#endif
 	};
 
+	/** Instances currently in use by OBS, so that encoders can be looked up from outside of StreamFX. */
+	void track_encoder_instance(obs_encoder_t* encoder, encoder_instance* instance);
+	void untrack_encoder_instance(obs_encoder_t* encoder);
+
 	template<class _factory, typename _instance>
 	class encoder_factory {
 		public:
@@ -188,8 +228,10 @@ namespace streamfx::obs {
 
 		static void* _create(obs_data_t* settings, obs_encoder_t* encoder) noexcept
 		try {
-			auto* fac = reinterpret_cast<factory_t*>(obs_encoder_get_type_data(encoder));
-			return fac->create(settings, encoder, false);
+			auto* fac      = reinterpret_cast<factory_t*>(obs_encoder_get_type_data(encoder));
+			auto* instance = fac->create(settings, encoder, false);
+			track_encoder_instance(encoder, reinterpret_cast<instance_t*>(instance));
+			return instance;
 		} catch (const std::exception& ex) {
 			DLOG_ERROR("Unexpected exception in function '%s': %s.", __FUNCTION_NAME__, ex.what());
 			return nullptr;
@@ -202,7 +244,9 @@ namespace streamfx::obs {
 		try {
 			auto* fac = reinterpret_cast<factory_t*>(obs_encoder_get_type_data(encoder));
 			try {
-				return fac->create(settings, encoder, true);
+				auto* instance = fac->create(settings, encoder, true);
+				track_encoder_instance(encoder, reinterpret_cast<instance_t*>(instance));
+				return instance;
 			} catch (...) {
 				return obs_encoder_create_rerouted(encoder, fac->_info_fallback.id);
 			}
@@ -265,8 +309,11 @@ namespace streamfx::obs {
 		private /* Instance */:
 		static void _destroy(void* data) noexcept
 		try {
-			if (data)
-				delete reinterpret_cast<instance_t*>(data);
+			if (data) {
+				auto* instance = reinterpret_cast<instance_t*>(data);
+				untrack_encoder_instance(instance->get());
+				delete instance;
+			}
 		} catch (const std::exception& ex) {
 			DLOG_ERROR("Unexpected exception in function '%s': %s.", __FUNCTION_NAME__, ex.what());
 		} catch (...) {
@@ -278,7 +325,9 @@ namespace streamfx::obs {
 			auto priv = reinterpret_cast<encoder_instance*>(data);
 			if (priv) {
 				reinterpret_cast<factory_t*>(obs_encoder_get_type_data(priv->get()))->_migrate(settings, priv);
-				return priv->update(settings);
+				bool result = priv->update(settings);
+				priv->update_keyframe_request(settings);
+				return result;
 			}
 			return false;
 		} catch (const std::exception& ex) {
@@ -0,0 +1,58 @@
+/*
+ * Modern effects for a modern Streamer
+ * Copyright (C) 2020 Michael Fabian Dirks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#pragma once
+#include <cstdint>
+
+// Shared with tools that load StreamFX through libOBS (like the encoder benchmark), so this must stay plain C data
+// and may not include anything from StreamFX itself.
+
+extern "C" {
+struct obs_encoder;
+
+/** Durations of one stage of encoding, in nanoseconds. */
+struct streamfx_encoder_stage {
+	uint64_t count;
+	uint64_t total;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+/** What an encoder tracked about itself so far. Stages stay empty unless built with ENABLE_PROFILING. */
+struct streamfx_encoder_statistics {
+	streamfx_encoder_stage copy;             // Copying frames from OBS into memory owned by the encoder.
+	streamfx_encoder_stage convert;          // Converting frames into a format the encoder supports.
+	streamfx_encoder_stage encode;           // Handing frames to the encoder.
+	streamfx_encoder_stage packet;           // Retrieving packets from the encoder.
+	uint64_t               pool_peak_bytes;  // Most memory held by idle pooled frames at once.
+	uint64_t               graphics_waits;   // Number of times the graphics context was entered.
+	uint64_t               graphics_wait_ns; // Total time spent waiting to enter the graphics context.
+};
+
+/** Exported by StreamFX, find it with os_dlsym(obs_get_module_lib(module), ST_ENCODER_GET_STATISTICS).
+ *
+ * @return false if the encoder is not a StreamFX encoder, not initialized yet or tracks nothing.
+ */
+typedef bool (*streamfx_encoder_get_statistics_t)(struct obs_encoder* encoder,
+												  struct streamfx_encoder_statistics* statistics);
+}
+
+#define ST_ENCODER_GET_STATISTICS "streamfx_encoder_get_statistics"
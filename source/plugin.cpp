@@ -91,9 +91,13 @@
 //static std::shared_ptr<streamfx::updater> _updater;
 #endif
 
+// Optional override for the number of Thread Pool workers, 0 or unset uses the hardware thread count.
+#define ST_CFG_THREADPOOL_WORKERS "threadpool.workers"
+
 static std::shared_ptr<streamfx::util::threadpool>       _threadpool;
 static std::shared_ptr<streamfx::obs::gs::vertex_buffer> _gs_fstri_vb;
 static std::shared_ptr<streamfx::gfx::opengl>            _streamfx_gfx_opengl;
+static bool                                              _headless = false;
 
 MODULE_EXPORT bool obs_module_load(void)
 try {
@@ -103,13 +107,31 @@ try {
 	streamfx::configuration::initialize();
 
 	// Initialize global Thread Pool.
-	_threadpool = std::make_shared<streamfx::util::threadpool>();
+	{
+		std::size_t concurrency = 0;
+		if (auto config = streamfx::configuration::instance(); config) {
+			auto dataptr = config->get();
+			if (obs_data_has_user_value(dataptr.get(), ST_CFG_THREADPOOL_WORKERS)) {
+				concurrency = static_cast<std::size_t>(
+					std::max<long long>(obs_data_get_int(dataptr.get(), ST_CFG_THREADPOOL_WORKERS), 0));
+			}
+		}
+		_threadpool = std::make_shared<streamfx::util::threadpool>(concurrency);
+	}
 
 	// Initialize Source Tracker
 	streamfx::obs::source_tracker::initialize();
 
+	// Without a graphics subsystem (like in the encoder benchmark) only the encoders can work.
+	obs_enter_graphics();
+	_headless = (gs_get_context() == nullptr);
+	obs_leave_graphics();
+	if (_headless) {
+		DLOG_WARNING("No graphics subsystem available, only loading encoders.");
+	}
+
 	// Initialize GLAD (OpenGL)
-	{
+	if (!_headless) {
 		streamfx::obs::gs::context gctx{};
 		_streamfx_gfx_opengl = streamfx::gfx::opengl::get();
 	}
@@ -125,7 +147,7 @@ try {
 #endif
 
 	// GS Stuff
-	{
+	if (!_headless) {
 		_gs_fstri_vb = std::make_shared<streamfx::obs::gs::vertex_buffer>(uint32_t(3), uint8_t(1));
 		{
 			auto vtx = _gs_fstri_vb->at(0);
@@ -157,7 +179,7 @@ try {
 	}
 
 	// Filters
-	{
+	if (!_headless) {
 #ifdef ENABLE_FILTER_AUTOFRAMING
 		streamfx::filter::autoframing::autoframing_factory::initialize();
 #endif
@@ -194,7 +216,7 @@ try {
 	}
 
 	// Sources
-	{
+	if (!_headless) {
 #ifdef ENABLE_SOURCE_MIRROR
 		streamfx::source::mirror::mirror_factory::initialize();
 #endif
@@ -204,7 +226,7 @@ try {
 	}
 
 	// Transitions
-	{
+	if (!_headless) {
 #ifdef ENABLE_TRANSITION_SHADER
 		streamfx::transition::shader::shader_factory::initialize();
 #endif
@@ -212,7 +234,9 @@ try {
 
 // Frontend
 #ifdef ENABLE_FRONTEND
-	streamfx::ui::handler::initialize();
+	if (!_headless) {
+		streamfx::ui::handler::initialize();
+	}
 #endif
 
 	DLOG_INFO("Loaded Version %s", STREAMFX_VERSION_STRING);
@@ -231,18 +255,20 @@ try {
 
 	// Frontend
 #ifdef ENABLE_FRONTEND
-	streamfx::ui::handler::finalize();
+	if (!_headless) {
+		streamfx::ui::handler::finalize();
+	}
 #endif
 
 	// Transitions
-	{
+	if (!_headless) {
 #ifdef ENABLE_TRANSITION_SHADER
 		streamfx::transition::shader::shader_factory::finalize();
 #endif
 	}
 
 	// Sources
-	{
+	if (!_headless) {
 #ifdef ENABLE_SOURCE_MIRROR
 		streamfx::source::mirror::mirror_factory::finalize();
 #endif
@@ -252,7 +278,7 @@ try {
 	}
 
 	// Filters
-	{
+	if (!_headless) {
 #ifdef ENABLE_FILTER_AUTOFRAMING
 		streamfx::filter::autoframing::autoframing_factory::finalize();
 #endif
@@ -304,7 +330,7 @@ try {
 	}
 
 	// Finalize GLAD (OpenGL)
-	{
+	if (!_headless) {
 		streamfx::obs::gs::context gctx{};
 		_streamfx_gfx_opengl.reset();
 	}
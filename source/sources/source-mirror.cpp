@@ -278,7 +278,8 @@ void mirror_instance::on_audio(std::shared_ptr<obs_source_t>, const audio_data*
 	}
 
 	// Create a clone of the audio data and push it to the thread pool.
-	streamfx::threadpool()->push(std::bind(&mirror_instance::audio_output, this, std::placeholders::_1), nullptr);
+	streamfx::threadpool()->push(std::bind(&mirror_instance::audio_output, this, std::placeholders::_1), nullptr,
+								 streamfx::util::threadpool::priority::REALTIME);
 }
 
 void mirror_instance::audio_output(std::shared_ptr<void> data)
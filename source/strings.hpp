@@ -37,6 +37,9 @@
 #define S_VERSION "Version"
 #define S_COMMIT "Commit"
 
+// Changing this on an active encoder (e.g. with obs_encoder_update()) makes the next frame a key frame.
+#define S_KEYFRAME_REQUEST "KeyFrame.Request"
+
 #define S_ADVANCED "Advanced"
 
 #define S_STATE_DEFAULT "State.Default"
@@ -454,7 +454,8 @@ void streamfx::updater::refresh()
 		save();
 
 		// Spawn a new task.
-		_task = streamfx::threadpool()->push(std::bind(&streamfx::updater::task, this, std::placeholders::_1), nullptr);
+		_task = streamfx::threadpool()->push(std::bind(&streamfx::updater::task, this, std::placeholders::_1), nullptr,
+											 streamfx::util::threadpool::priority::BACKGROUND);
 	} else {
 		events.refreshed(*this);
 	}
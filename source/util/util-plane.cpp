@@ -0,0 +1,81 @@
+// Copyright 2020 Michael Fabian 'Xaymar' Dirks <info@xaymar.com>
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+// OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+// OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "util-plane.hpp"
+#include <algorithm>
+#include <cstring>
+#include "util-threadpool.hpp"
+
+// Each thread should get at least this many bytes to copy, otherwise the scheduling overhead dominates.
+#define ST_PLANE_THREAD_THRESHOLD (2 * 1024 * 1024)
+
+namespace {
+	void copy_rows(uint8_t* target, std::size_t target_stride, const uint8_t* source, std::size_t source_stride,
+				   std::size_t width, std::size_t height)
+	{
+		// Contiguous planes need no per-row handling at all.
+		if ((target_stride == width) && (source_stride == width)) {
+			std::memcpy(target, source, width * height);
+			return;
+		}
+
+		for (std::size_t y = 0; y < height; y++) {
+			std::memcpy(target + y * target_stride, source + y * source_stride, width);
+		}
+	}
+} // namespace
+
+void streamfx::util::plane::copy(uint8_t* target, std::size_t target_stride, const uint8_t* source,
+								 std::size_t source_stride, std::size_t width, std::size_t height,
+								 std::shared_ptr<::streamfx::util::threadpool> pool)
+{
+	if (!target || !source || (width == 0) || (height == 0)) {
+		return;
+	}
+
+	std::size_t slices = 1;
+	if (pool) {
+		slices = std::min<std::size_t>((width * height) / ST_PLANE_THREAD_THRESHOLD, pool->concurrency());
+		slices = std::min(slices, height);
+	}
+	if (slices <= 1) {
+		copy_rows(target, target_stride, source, source_stride, width, height);
+		return;
+	}
+
+	// Hand all but the first range of rows to the pool, and copy that one ourselves.
+	std::size_t                            rows = (height + slices - 1) / slices;
+	streamfx::util::threadpool::task_group group;
+	for (std::size_t row = rows; row < height; row += rows) {
+		std::size_t    count = std::min(rows, height - row);
+		uint8_t*       to    = target + row * target_stride;
+		const uint8_t* from  = source + row * source_stride;
+		group.add(pool->push(
+			[to, target_stride, from, source_stride, width, count](streamfx::util::threadpool_data_t) {
+				copy_rows(to, target_stride, from, source_stride, width, count);
+			},
+			nullptr, streamfx::util::threadpool::priority::REALTIME));
+	}
+	copy_rows(target, target_stride, source, source_stride, width, rows);
+	group.wait();
+}
@@ -38,8 +38,19 @@
 #define D_LOG_DEBUG(...) P_LOG_DEBUG(ST_PREFIX __VA_ARGS__)
 #endif
 
+#include <stdexcept>
+
 #ifdef WIN32
 #include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
 
 std::string streamfx::util::platform::native_to_utf8(std::wstring const& v)
 {
@@ -84,3 +95,89 @@ std::filesystem::path streamfx::util::platform::utf8_to_native(std::filesystem::
 }
 
 #endif
+
+#ifdef WIN32
+streamfx::util::platform::mapped_file::mapped_file(std::filesystem::path const& file)
+	: _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+{
+	auto wfile = utf8_to_native(file.u8string());
+
+	_file = CreateFileW(wfile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+						nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		D_LOG_ERROR("Failed to open '%s' for reading (code %" PRIu32 ").", file.u8string().c_str(),
+					static_cast<uint32_t>(GetLastError()));
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || (size.QuadPart == 0)) {
+		CloseHandle(_file);
+		D_LOG_ERROR("File '%s' is empty or its size is unknown.", file.u8string().c_str());
+		throw std::runtime_error("Failed to map file.");
+	}
+	_size = static_cast<std::size_t>(size.QuadPart);
+
+	_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping) {
+		_data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!_data) {
+		D_LOG_ERROR("Failed to map '%s' into memory (code %" PRIu32 ").", file.u8string().c_str(),
+					static_cast<uint32_t>(GetLastError()));
+		if (_mapping) {
+			CloseHandle(_mapping);
+		}
+		CloseHandle(_file);
+		throw std::runtime_error("Failed to map file.");
+	}
+}
+
+streamfx::util::platform::mapped_file::~mapped_file()
+{
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+	CloseHandle(_file);
+}
+#else
+streamfx::util::platform::mapped_file::mapped_file(std::filesystem::path const& file)
+	: _data(nullptr), _size(0), _file(-1)
+{
+	_file = open(file.u8string().c_str(), O_RDONLY);
+	if (_file == -1) {
+		D_LOG_ERROR("Failed to open '%s' for reading (code %" PRId32 ").", file.u8string().c_str(), errno);
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	struct stat info;
+	if ((fstat(_file, &info) != 0) || (info.st_size == 0)) {
+		close(_file);
+		D_LOG_ERROR("File '%s' is empty or its size is unknown.", file.u8string().c_str());
+		throw std::runtime_error("Failed to map file.");
+	}
+	_size = static_cast<std::size_t>(info.st_size);
+
+	_data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+	if (_data == MAP_FAILED) {
+		D_LOG_ERROR("Failed to map '%s' into memory (code %" PRId32 ").", file.u8string().c_str(), errno);
+		close(_file);
+		throw std::runtime_error("Failed to map file.");
+	}
+}
+
+streamfx::util::platform::mapped_file::~mapped_file()
+{
+	munmap(_data, _size);
+	close(_file);
+}
+#endif
+
+const void* streamfx::util::platform::mapped_file::data() const
+{
+	return _data;
+}
+
+std::size_t streamfx::util::platform::mapped_file::size() const
+{
+	return _size;
+}
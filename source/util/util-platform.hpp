@@ -22,6 +22,7 @@
 // OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
+#include <cstddef>
 #include <filesystem>
 #include <string>
 
@@ -51,4 +52,27 @@ namespace streamfx::util::platform {
 		return std::filesystem::path(v);
 	};
 #endif
+
+	// Read-only view of an entire file, served from the page cache instead of being read into memory.
+	class mapped_file {
+		void*       _data;
+		std::size_t _size;
+#ifdef WIN32
+		void* _file;
+		void* _mapping;
+#else
+		int _file;
+#endif
+
+		public:
+		mapped_file(std::filesystem::path const& file);
+		~mapped_file();
+
+		mapped_file(mapped_file const&) = delete;
+		mapped_file& operator=(mapped_file const&) = delete;
+
+		const void* data() const;
+
+		std::size_t size() const;
+	};
 } // namespace streamfx::util::platform
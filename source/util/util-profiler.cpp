@@ -18,130 +18,244 @@
  */
 
 #include "util-profiler.hpp"
-#include <iterator>
+#include <algorithm>
+#include <cmath>
 
-streamfx::util::profiler::profiler() {}
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-streamfx::util::profiler::~profiler() {}
+namespace {
+	constexpr std::size_t half_bucket_count = std::size_t(1) << (streamfx::util::profiler::sub_bucket_bits - 1);
 
-std::shared_ptr<streamfx::util::profiler::instance> streamfx::util::profiler::track()
+	std::atomic<uint64_t> profiler_ids{0};
+
+	inline std::size_t bucket_of(uint64_t value)
+	{
+		value = std::min<uint64_t>(value, (uint64_t(1) << streamfx::util::profiler::max_bits) - 1);
+		if (value < (half_bucket_count << 1)) {
+			return static_cast<std::size_t>(value);
+		}
+
+#ifdef _MSC_VER
+		unsigned long msb = 0;
+		_BitScanReverse64(&msb, value);
+#else
+		std::size_t msb = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+#endif
+		std::size_t shift = msb - (streamfx::util::profiler::sub_bucket_bits - 1);
+		return shift * half_bucket_count + static_cast<std::size_t>(value >> shift);
+	}
+
+	// The highest value that falls into a bucket.
+	inline uint64_t value_of(std::size_t bucket)
+	{
+		if (bucket < (half_bucket_count << 1)) {
+			return bucket;
+		}
+
+		std::size_t shift    = (bucket / half_bucket_count) - 1;
+		uint64_t    mantissa = bucket - shift * half_bucket_count;
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+	// Threads remember the shards they used last, so finding one rarely needs the lock.
+	struct shard_cache_entry {
+		uint64_t id;
+		void*    shard;
+	};
+	constexpr std::size_t                                        shard_cache_size = 8;
+	thread_local std::array<shard_cache_entry, shard_cache_size> shard_cache{};
+	thread_local std::size_t                                     shard_cache_next = 0;
+} // namespace
+
+streamfx::util::profiler::shard::shard(std::thread::id owner) : owner(owner), count(0), total(0), counts()
 {
-	return std::make_shared<streamfx::util::profiler::instance>(shared_from_this());
+	for (auto& v : counts) {
+		v.store(0, std::memory_order_relaxed);
+	}
 }
 
-void streamfx::util::profiler::track(std::chrono::nanoseconds duration)
+streamfx::util::profiler::profiler() : _id(++profiler_ids), _shards_lock(), _shards() {}
+
+streamfx::util::profiler::~profiler() {}
+
+streamfx::util::profiler::shard& streamfx::util::profiler::local_shard()
 {
-	std::unique_lock<std::mutex> ul(_timings_lock);
-	auto                         itr = _timings.find(duration);
-	if (itr == _timings.end()) {
-		_timings.emplace(duration, 1u);
-	} else {
-		itr->second++;
+	for (auto& entry : shard_cache) {
+		if (entry.id == _id) {
+			return *static_cast<shard*>(entry.shard);
+		}
+	}
+
+	// Ids are never reused, so entries of profilers that are gone simply never match again.
+	shard* local = nullptr;
+	{
+		std::unique_lock<std::mutex> ul(_shards_lock);
+		auto                         owner = std::this_thread::get_id();
+		for (auto& v : _shards) {
+			if (v->owner == owner) {
+				local = v.get();
+				break;
+			}
+		}
+		if (!local) {
+			_shards.push_back(std::make_unique<shard>(owner));
+			local = _shards.back().get();
+		}
 	}
+
+	shard_cache[shard_cache_next] = {_id, local};
+	shard_cache_next              = (shard_cache_next + 1) % shard_cache_size;
+	return *local;
 }
 
-uint64_t streamfx::util::profiler::count()
+uint64_t streamfx::util::profiler::merge(std::array<uint64_t, buckets>& counts, uint64_t* total)
 {
 	uint64_t count = 0;
 
-	std::map<std::chrono::nanoseconds, size_t> copy_timings;
-	{
-		std::unique_lock<std::mutex> ul(_timings_lock);
-		copy(_timings.begin(), _timings.end(), std::inserter(copy_timings, copy_timings.end()));
+	counts.fill(0);
+	if (total) {
+		*total = 0;
 	}
 
-	for (auto kv : copy_timings) {
-		count += kv.second;
+	std::unique_lock<std::mutex> ul(_shards_lock);
+	for (auto& v : _shards) {
+		for (std::size_t idx = 0; idx < buckets; idx++) {
+			uint64_t n = v->counts[idx].load(std::memory_order_relaxed);
+			counts[idx] += n;
+			count += n;
+		}
+		if (total) {
+			*total += v->total.load(std::memory_order_relaxed);
+		}
 	}
 
 	return count;
 }
 
-std::chrono::nanoseconds streamfx::util::profiler::total_duration()
+std::shared_ptr<streamfx::util::profiler::instance> streamfx::util::profiler::track()
 {
-	std::chrono::nanoseconds duration{0};
-
-	std::map<std::chrono::nanoseconds, size_t> copy_timings;
-	{
-		std::unique_lock<std::mutex> ul(_timings_lock);
-		copy(_timings.begin(), _timings.end(), std::inserter(copy_timings, copy_timings.end()));
-	}
+	return std::make_shared<streamfx::util::profiler::instance>(shared_from_this());
+}
 
-	for (auto kv : copy_timings) {
-		duration += kv.first * kv.second;
-	}
+void streamfx::util::profiler::track(std::chrono::nanoseconds duration)
+{
+	uint64_t value = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+	auto&    local = local_shard();
 
-	return duration;
+	// Only the owning thread writes to a shard, so a plain load and store is enough and avoids locked instructions.
+	auto& bucket = local.counts[bucket_of(value)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	local.total.store(local.total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	local.count.store(local.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
 
-double_t streamfx::util::profiler::average_duration()
+uint64_t streamfx::util::profiler::count()
 {
-	std::chrono::nanoseconds duration{0};
-	uint64_t                 count = 0;
+	uint64_t count = 0;
 
-	std::map<std::chrono::nanoseconds, size_t> copy_timings;
-	{
-		std::unique_lock<std::mutex> ul(_timings_lock);
-		copy(_timings.begin(), _timings.end(), std::inserter(copy_timings, copy_timings.end()));
+	std::unique_lock<std::mutex> ul(_shards_lock);
+	for (auto& v : _shards) {
+		count += v->count.load(std::memory_order_relaxed);
 	}
 
-	for (auto kv : copy_timings) {
-		duration += kv.first * kv.second;
-		count += kv.second;
+	return count;
+}
+
+std::chrono::nanoseconds streamfx::util::profiler::total_duration()
+{
+	uint64_t total = 0;
+
+	std::unique_lock<std::mutex> ul(_shards_lock);
+	for (auto& v : _shards) {
+		total += v->total.load(std::memory_order_relaxed);
 	}
 
-	return double_t(duration.count()) / double_t(count);
+	return std::chrono::nanoseconds(total);
 }
 
-template<typename T>
-inline bool is_equal(T a, T b, T c)
+double_t streamfx::util::profiler::average_duration()
 {
-	return (a == b) || ((a >= (b - c)) && (a <= (b + c)));
+	uint64_t count = 0;
+	uint64_t total = 0;
+
+	std::unique_lock<std::mutex> ul(_shards_lock);
+	for (auto& v : _shards) {
+		count += v->count.load(std::memory_order_relaxed);
+		total += v->total.load(std::memory_order_relaxed);
+	}
+
+	return double_t(total) / double_t(count);
 }
 
 std::chrono::nanoseconds streamfx::util::profiler::percentile(double_t percentile, bool by_time)
 {
-	constexpr double_t edge  = 0.00005;
-	uint64_t           calls = count();
-
-	std::map<std::chrono::nanoseconds, size_t> copy_timings;
-	{
-		std::unique_lock<std::mutex> ul(_timings_lock);
-		copy(_timings.begin(), _timings.end(), inserter(copy_timings, copy_timings.end()));
+	std::array<uint64_t, buckets> counts;
+	uint64_t                      calls = merge(counts);
+	if (calls == 0) {
+		return std::chrono::nanoseconds(-1);
 	}
+
 	if (by_time) { // Return by time percentile.
 		// Find largest and smallest time.
-		std::chrono::nanoseconds smallest = copy_timings.begin()->first;
-		std::chrono::nanoseconds largest  = copy_timings.rbegin()->first;
-		std::chrono::nanoseconds variance = largest - smallest;
-
-		for (auto kv : copy_timings) {
-			double_t kv_pct = double_t((kv.first - smallest).count()) / double_t(variance.count());
-			if (is_equal<double_t>(kv_pct, percentile, edge) || (kv_pct > percentile)) {
-				return std::chrono::nanoseconds(kv.first);
+		std::size_t smallest = 0;
+		std::size_t largest  = buckets - 1;
+		while (counts[smallest] == 0) {
+			++smallest;
+		}
+		while (counts[largest] == 0) {
+			--largest;
+		}
+
+		double_t target = double_t(value_of(smallest)) + double_t(value_of(largest) - value_of(smallest)) * percentile;
+		for (std::size_t idx = smallest; idx <= largest; idx++) {
+			if ((counts[idx] != 0) && (double_t(value_of(idx)) >= target)) {
+				return std::chrono::nanoseconds(value_of(idx));
 			}
 		}
+		return std::chrono::nanoseconds(value_of(largest));
 	} else { // Return by call percentile.
-		if (percentile == 0.0) {
-			return copy_timings.begin()->first;
+		uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(percentile * double_t(calls))), 1);
+		uint64_t accu = 0;
+		for (std::size_t idx = 0; idx < buckets; idx++) {
+			accu += counts[idx];
+			if (accu >= rank) {
+				return std::chrono::nanoseconds(value_of(idx));
+			}
 		}
+	}
+
+	return std::chrono::nanoseconds(-1);
+}
 
-		uint64_t accu_calls_now = 0;
-		for (auto kv : copy_timings) {
-			uint64_t accu_calls_last = accu_calls_now;
-			accu_calls_now += kv.second;
+streamfx::util::profiler::summary_t streamfx::util::profiler::summary()
+{
+	std::array<uint64_t, buckets> counts;
+	uint64_t                      total = 0;
+	summary_t                     result{};
 
-			double_t percentile_last = double_t(accu_calls_last) / double_t(calls);
-			double_t percentile_now  = double_t(accu_calls_now) / double_t(calls);
+	result.count = merge(counts, &total);
+	result.total = std::chrono::nanoseconds(total);
 
-			if (is_equal<double_t>(percentile, percentile_now, edge)
-				|| ((percentile_last < percentile) && (percentile_now > percentile))) {
-				return std::chrono::nanoseconds(kv.first);
-			}
+	std::array<std::pair<double_t, std::chrono::nanoseconds*>, 4> targets = {{
+		{0.5, &result.p50},
+		{0.9, &result.p90},
+		{0.99, &result.p99},
+		{0.999, &result.p999},
+	}};
+	std::size_t target = 0;
+	uint64_t    accu   = 0;
+	for (std::size_t idx = 0; (idx < buckets) && (target < targets.size()); idx++) {
+		accu += counts[idx];
+		while ((target < targets.size()) && (accu > 0)
+			   && (accu >= static_cast<uint64_t>(std::ceil(targets[target].first * double_t(result.count))))) {
+			*targets[target].second = std::chrono::nanoseconds(value_of(idx));
+			++target;
 		}
 	}
 
-	return std::chrono::nanoseconds(-1);
+	return result;
 }
 
 streamfx::util::profiler::instance::instance(std::shared_ptr<streamfx::util::profiler> parent)
@@ -19,14 +19,46 @@
 
 #pragma once
 #include "common.hpp"
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <map>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 namespace streamfx::util {
 	class profiler : public std::enable_shared_from_this<streamfx::util::profiler> {
-		std::map<std::chrono::nanoseconds, size_t> _timings;
-		std::mutex                                 _timings_lock;
+		public:
+		// Log-linear buckets: values below 2^sub_bucket_bits are exact, every power of two above is split into
+		// 2^(sub_bucket_bits - 1) buckets, for a relative error of at most 1/64. Values from 2^max_bits ns (~73
+		// minutes) up land in the last bucket.
+		static constexpr std::size_t sub_bucket_bits = 7;
+		static constexpr std::size_t max_bits        = 42;
+		static constexpr std::size_t buckets         = (max_bits - sub_bucket_bits + 2) << (sub_bucket_bits - 1);
+
+		struct summary_t {
+			uint64_t                 count;
+			std::chrono::nanoseconds total;
+			std::chrono::nanoseconds p50;
+			std::chrono::nanoseconds p90;
+			std::chrono::nanoseconds p99;
+			std::chrono::nanoseconds p999;
+		};
+
+		private:
+		// Each thread records into its own shard, so recording never waits and never contends on a cache line.
+		struct alignas(64) shard {
+			std::thread::id                            owner;
+			std::atomic<uint64_t>                      count;
+			std::atomic<uint64_t>                      total;
+			std::array<std::atomic<uint64_t>, buckets> counts;
+
+			shard(std::thread::id owner);
+		};
+
+		uint64_t                            _id;
+		std::mutex                          _shards_lock;
+		std::vector<std::unique_ptr<shard>> _shards;
 
 		public:
 		class instance {
@@ -46,6 +78,11 @@ namespace streamfx::util {
 		private:
 		profiler();
 
+		shard& local_shard();
+
+		// Sum up the buckets of all shards, returns the number of recorded durations.
+		uint64_t merge(std::array<uint64_t, buckets>& counts, uint64_t* total = nullptr);
+
 		public:
 		~profiler();
 
@@ -61,6 +98,9 @@ namespace streamfx::util {
 
 		std::chrono::nanoseconds percentile(double_t percentile, bool by_time = false);
 
+		/** Count, total and the common percentiles, from a single merge of all shards. */
+		summary_t summary();
+
 		public:
 		static std::shared_ptr<streamfx::util::profiler> create()
 		{
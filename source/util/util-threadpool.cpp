@@ -19,6 +19,7 @@
 
 #include "util-threadpool.hpp"
 #include "common.hpp"
+#include <array>
 #include <cstddef>
 #include "util/util-logging.hpp"
 
@@ -36,125 +37,454 @@
 #define D_LOG_DEBUG(...) P_LOG_DEBUG(ST_PREFIX __VA_ARGS__)
 #endif
 
-// Most Tasks likely wait for IO, so we can use that time for other tasks.
-#define ST_CONCURRENCY_MULTIPLIER 2
+// Tasks don't carry their own mutex and condition variable, waiting threads park on a shared one instead.
+struct parking_spot {
+	std::mutex              lock;
+	std::condition_variable cv;
+};
 
-streamfx::util::threadpool::threadpool()
-	: _workers(), _worker_stop(false), _worker_idx(0), _tasks(), _tasks_lock(), _tasks_cv()
+static parking_spot& parking_spot_for(const void* ptr)
 {
-	std::size_t concurrency = static_cast<size_t>(std::thread::hardware_concurrency() * ST_CONCURRENCY_MULTIPLIER);
-	for (std::size_t n = 0; n < concurrency; n++) {
-		_workers.emplace_back(std::bind(&streamfx::util::threadpool::work, this));
+	static std::array<parking_spot, 64> spots;
+	return spots[(reinterpret_cast<uintptr_t>(ptr) / streamfx::util::threadpool_memory::block_size) % spots.size()];
+}
+
+// Recycled task memory. Blocks are carved out of larger slabs and never returned to the system while loaded.
+#define ST_SLAB_BLOCKS 64
+
+struct block_pool {
+	union block {
+		block* next;
+		alignas(std::max_align_t) unsigned char data[streamfx::util::threadpool_memory::block_size];
+	};
+
+	std::mutex                            lock;
+	block*                                free = nullptr;
+	std::vector<std::unique_ptr<block[]>> slabs;
+};
+
+static block_pool& get_block_pool()
+{
+	static block_pool pool;
+	return pool;
+}
+
+void* streamfx::util::threadpool_memory::allocate(std::size_t size)
+{
+	if (size > block_size) {
+		return ::operator new(size);
 	}
+
+	auto&                        pool = get_block_pool();
+	std::unique_lock<std::mutex> lock(pool.lock);
+	if (!pool.free) {
+		auto slab = std::make_unique<block_pool::block[]>(ST_SLAB_BLOCKS);
+		for (std::size_t idx = 0; idx < ST_SLAB_BLOCKS; idx++) {
+			slab[idx].next = pool.free;
+			pool.free      = &slab[idx];
+		}
+		pool.slabs.emplace_back(std::move(slab));
+	}
+
+	auto ptr  = pool.free;
+	pool.free = ptr->next;
+	return ptr;
+}
+
+void streamfx::util::threadpool_memory::deallocate(void* ptr, std::size_t size)
+{
+	if (size > block_size) {
+		::operator delete(ptr);
+		return;
+	}
+
+	auto&                        pool = get_block_pool();
+	std::unique_lock<std::mutex> lock(pool.lock);
+	auto                         blk = static_cast<block_pool::block*>(ptr);
+	blk->next                        = pool.free;
+	pool.free                        = blk;
+}
+
+// The worker a thread belongs to, if any. Used to keep work pushed from a worker local to it.
+static thread_local streamfx::util::threadpool* _local_pool  = nullptr;
+static thread_local std::size_t                 _local_lane  = 0;
+static thread_local std::size_t                 _local_index = 0;
+
+streamfx::util::threadpool::threadpool(std::size_t concurrency)
+	: _lanes(), _workers(), _worker_stop(false), _worker_idx(0)
+{
+	if (concurrency == 0) {
+		concurrency = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	// A quarter each for real-time and background work, the rest handles interactive work.
+	std::array<std::size_t, priorities> lane_workers;
+	lane_workers[static_cast<std::size_t>(priority::REALTIME)]   = std::max<std::size_t>(concurrency / 4, 1);
+	lane_workers[static_cast<std::size_t>(priority::BACKGROUND)] = std::max<std::size_t>(concurrency / 4, 1);
+	lane_workers[static_cast<std::size_t>(priority::INTERACTIVE)] =
+		std::max<std::size_t>(concurrency - std::min(concurrency, lane_workers[0] + lane_workers[2]), 1);
+
+	for (std::size_t lane = 0; lane < priorities; lane++) {
+		_lanes[lane].queues.reserve(lane_workers[lane]);
+		for (std::size_t n = 0; n < lane_workers[lane]; n++) {
+			_lanes[lane].queues.emplace_back(std::make_unique<worker_queue>());
+		}
+	}
+
+	for (std::size_t lane = 0; lane < priorities; lane++) {
+		for (std::size_t n = 0; n < lane_workers[lane]; n++) {
+			_workers.emplace_back(std::bind(&streamfx::util::threadpool::work, this, lane, n));
+		}
+	}
+
+	D_LOG_INFO("Started %zu worker threads (%zu real-time, %zu interactive, %zu background).", _workers.size(),
+			   lane_workers[0], lane_workers[1], lane_workers[2]);
 }
 
 streamfx::util::threadpool::~threadpool()
 {
 	_worker_stop = true;
-	_tasks_cv.notify_all();
+	for (auto& lane : _lanes) {
+		{
+			std::unique_lock<std::mutex> lock(lane.sleep_lock);
+		}
+		lane.sleep_cv.notify_all();
+	}
 	for (auto& thread : _workers) {
-		_tasks_cv.notify_all();
 		if (thread.joinable()) {
 			thread.join();
 		}
 	}
+
+	// Anything still queued will never run, so release whoever is waiting on it.
+	for (auto& lane : _lanes) {
+		for (auto& queue : lane.queues) {
+			std::unique_lock<std::mutex> lock(queue->lock);
+			for (auto& task : queue->tasks) {
+				pop(task);
+			}
+			queue->tasks.clear();
+		}
+	}
 }
 
-std::shared_ptr<::streamfx::util::threadpool::task> streamfx::util::threadpool::push(threadpool_callback_t fn,
-																					 threadpool_data_t     data)
+void streamfx::util::threadpool::enqueue(std::shared_ptr<::streamfx::util::threadpool::task> task)
 {
-	auto task = std::make_shared<streamfx::util::threadpool::task>(fn, data);
+	std::size_t lane_idx = static_cast<std::size_t>(task->_priority);
+	if (lane_idx >= priorities) {
+		throw std::invalid_argument("Invalid priority.");
+	}
+	auto& lane = _lanes[lane_idx];
 
-	// Append the task to the queue.
-	std::unique_lock<std::mutex> lock(_tasks_lock);
-	_tasks.emplace_back(task);
-	_tasks_cv.notify_one();
+	// Nothing will pick up work while shutting down.
+	if (_worker_stop) {
+		task->complete(true);
+		return;
+	}
 
-	return task;
+	// Work pushed by one of our own workers stays with that worker, everything else is spread evenly.
+	std::size_t index;
+	if ((_local_pool == this) && (_local_lane == lane_idx)) {
+		index = _local_index;
+	} else {
+		index = lane.push_idx.fetch_add(1, std::memory_order_relaxed) % lane.queues.size();
+	}
+
+	// Append the task to the queue. It is counted first, as a worker may take it the moment it is visible.
+	{
+		std::unique_lock<std::mutex> lock(lane.queues[index]->lock);
+		lane.pending.fetch_add(1);
+		lane.queues[index]->tasks.emplace_back(std::move(task));
+	}
+
+	wake(lane_idx);
 }
 
 void streamfx::util::threadpool::pop(std::shared_ptr<::streamfx::util::threadpool::task> work)
 {
 	if (work) {
+		work->complete(true);
+	}
+}
+
+std::size_t streamfx::util::threadpool::concurrency() const
+{
+	return _workers.size();
+}
+
+std::size_t streamfx::util::threadpool::queue_depth(priority prio) const
+{
+	return _lanes.at(static_cast<std::size_t>(prio)).pending.load(std::memory_order_relaxed);
+}
+
+std::size_t streamfx::util::threadpool::missed_deadlines(priority prio) const
+{
+	return _lanes.at(static_cast<std::size_t>(prio)).missed.load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<::streamfx::util::threadpool::task> streamfx::util::threadpool::acquire(std::size_t lane_idx,
+																						std::size_t index)
+{
+	std::shared_ptr<streamfx::util::threadpool::task> task;
+
+	// Higher priority lanes always come first, but we only ever steal from them.
+	for (std::size_t lidx = 0; !task && (lidx <= lane_idx); lidx++) {
+		auto& lane = _lanes[lidx];
+		if (lane.pending.load(std::memory_order_relaxed) == 0) {
+			continue;
+		}
+
+		// Check our own queue first, in order.
+		if (lidx == lane_idx) {
+			auto&                        queue = lane.queues[index];
+			std::unique_lock<std::mutex> lock(queue->lock);
+			if (!queue->tasks.empty()) {
+				task = std::move(queue->tasks.front());
+				queue->tasks.pop_front();
+			}
+		}
+
+		// Then try to steal from the back of the other queues.
+		for (std::size_t n = 0; !task && (n < lane.queues.size()); n++) {
+			if ((lidx == lane_idx) && (n == index)) {
+				continue;
+			}
+
+			auto&                        queue = lane.queues[n];
+			std::unique_lock<std::mutex> lock(queue->lock, std::try_to_lock);
+			if (lock.owns_lock() && !queue->tasks.empty()) {
+				task = std::move(queue->tasks.back());
+				queue->tasks.pop_back();
+			}
+		}
+
+		if (task) {
+			lane.pending.fetch_sub(1);
+		}
+	}
+
+	return task;
+}
+
+bool streamfx::util::threadpool::has_work(std::size_t lane_idx) const
+{
+	for (std::size_t lidx = 0; lidx <= lane_idx; lidx++) {
+		if (_lanes[lidx].pending.load() > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void streamfx::util::threadpool::wake(std::size_t lane_idx)
+{
+	// Prefer a worker of the lane itself, then the lower priority lanes whose idle workers help out with this one.
+	for (std::size_t lidx = lane_idx; lidx < priorities; lidx++) {
+		auto& lane = _lanes[lidx];
+		if (lane.sleeping.load() == 0) {
+			continue;
+		}
+
 		{
-			std::unique_lock<std::mutex> lock(work->_mutex);
-			work->_is_dead = true;
+			std::unique_lock<std::mutex> lock(lane.sleep_lock);
 		}
-		work->_is_complete.notify_all();
+		lane.sleep_cv.notify_one();
+		return;
 	}
 }
 
-void streamfx::util::threadpool::work()
+void streamfx::util::threadpool::work(std::size_t lane_idx, std::size_t index)
 {
 	std::shared_ptr<streamfx::util::threadpool::task> local_work{};
 	uint32_t                                          local_number = _worker_idx.fetch_add(1);
+	auto&                                             lane         = _lanes[lane_idx];
+
+	_local_pool  = this;
+	_local_lane  = lane_idx;
+	_local_index = index;
 
 	while (!_worker_stop) {
-		// Wait for more work, or immediately continue if there is still work to do.
-		{
-			// Lock the tasks mutex to check for work.
-			std::unique_lock<std::mutex> lock(_tasks_lock);
+		// Grab the next task, or wait until there is more work.
+		local_work = acquire(lane_idx, index);
+		if (!local_work) {
+			// Counted before checking for work, so that a push either sees us sleeping or we see its task.
+			std::unique_lock<std::mutex> lock(lane.sleep_lock);
+			lane.sleeping.fetch_add(1);
+			lane.sleep_cv.wait(lock, [this, lane_idx]() { return _worker_stop || has_work(lane_idx); });
+			lane.sleeping.fetch_sub(1);
+			continue;
+		}
 
-			// If there are currently no tasks queued, wait on the condition variable.
-			// This temporarily unlocks the mutex until it is woken up.
-			if (_tasks.size() == 0) {
-				_tasks_cv.wait(lock, [this]() { return _worker_stop || _tasks.size() > 0; });
-			}
+		// A single push only wakes a single worker, pass the wake-up on if there is more left.
+		if (_lanes[static_cast<std::size_t>(local_work->_priority)].pending.load(std::memory_order_relaxed) > 0) {
+			wake(static_cast<std::size_t>(local_work->_priority));
+		}
 
-			// If there is either no tasks or we were asked to stop, skip everything.
-			if (_worker_stop || (_tasks.size() == 0)) {
-				continue;
-			}
+		// If the task was killed, skip everything again.
+		if (local_work->_state.load() != task::state::QUEUED) {
+			continue;
+		}
 
-			// Grab the latest task and immediately remove it from the queue.
-			local_work = _tasks.front();
-			_tasks.pop_front();
+		// Tasks that can no longer start in time are dropped.
+		if ((local_work->_deadline != deadline_t::max()) && (std::chrono::steady_clock::now() > local_work->_deadline)) {
+			_lanes[static_cast<std::size_t>(local_work->_priority)].missed.fetch_add(1, std::memory_order_relaxed);
+			local_work->complete(true);
+			continue;
 		}
 
-		// If the task was killed, skip everything again.
-		if (local_work->_is_dead.load()) {
+		// From here on the task can no longer be cancelled, only awaited.
+		if (!local_work->start()) {
 			continue;
 		}
 
 		// Try to execute work, but don't crash on catchable exceptions.
-		if (local_work->_callback) {
-			try {
-				local_work->_callback(local_work->_data);
-			} catch (std::exception const& ex) {
-				D_LOG_WARNING("Worker %" PRIx32 " caught exception from task (%" PRIxPTR ", %" PRIxPTR
-							  ") with message: %s",
-							  local_number, reinterpret_cast<ptrdiff_t>(local_work->_callback.target<void>()),
-							  reinterpret_cast<ptrdiff_t>(local_work->_data.get()), ex.what());
-			} catch (...) {
-				D_LOG_WARNING("Worker %" PRIx32 " caught exception of unknown type from task (%" PRIxPTR ", %" PRIxPTR
-							  ").",
-							  local_number, reinterpret_cast<ptrdiff_t>(local_work->_callback.target<void>()),
-							  reinterpret_cast<ptrdiff_t>(local_work->_data.get()));
-			}
-			{
-				std::unique_lock<std::mutex> lock(local_work->_mutex);
-				local_work->_is_dead.store(true);
-			}
-			local_work->_is_complete.notify_all();
+		try {
+			local_work->_invoke(local_work->_callable, local_work->_data);
+		} catch (std::exception const& ex) {
+			D_LOG_WARNING("Worker %" PRIx32 " caught exception from task (%" PRIxPTR ", %" PRIxPTR
+						  ") with message: %s",
+						  local_number, reinterpret_cast<ptrdiff_t>(local_work->_callable),
+						  reinterpret_cast<ptrdiff_t>(local_work->_data.get()), ex.what());
+		} catch (...) {
+			D_LOG_WARNING("Worker %" PRIx32 " caught exception of unknown type from task (%" PRIxPTR ", %" PRIxPTR
+						  ").",
+						  local_number, reinterpret_cast<ptrdiff_t>(local_work->_callable),
+						  reinterpret_cast<ptrdiff_t>(local_work->_data.get()));
 		}
+		local_work->complete(false);
 
 		// Remove our reference to the work unit.
 		local_work.reset();
 	}
 
+	_local_pool = nullptr;
 	_worker_idx.fetch_sub(1);
 }
 
-streamfx::util::threadpool::task::task() {}
-
-streamfx::util::threadpool::task::task(threadpool_callback_t fn, threadpool_data_t dt)
-	: _mutex(), _is_complete(), _is_dead(false), _callback(fn), _data(dt)
+streamfx::util::threadpool::task::task()
+	: _state(state::DONE), _is_cancelled(false), _data(), _priority(priority::INTERACTIVE),
+	  _deadline(deadline_t::max()), _pool(nullptr), _continuations(), _callable(nullptr), _invoke(nullptr),
+	  _destroy(nullptr)
 {}
 
+streamfx::util::threadpool::task::~task()
+{
+	if (_destroy) {
+		_destroy(_callable);
+	}
+}
+
 void streamfx::util::threadpool::task::await_completion()
 {
-	if (!_is_dead) {
-		std::unique_lock<std::mutex> lock(_mutex);
-		_is_complete.wait(lock, [this]() { return this->_is_dead.load(); });
+	if (_state.load(std::memory_order_acquire) == state::DONE) {
+		return;
+	}
+
+	auto&                        spot = parking_spot_for(this);
+	std::unique_lock<std::mutex> lock(spot.lock);
+	spot.cv.wait(lock, [this]() { return _state.load(std::memory_order_acquire) == state::DONE; });
+}
+
+bool streamfx::util::threadpool::task::start()
+{
+	state expected = state::QUEUED;
+	return _state.compare_exchange_strong(expected, state::RUNNING, std::memory_order_acq_rel);
+}
+
+void streamfx::util::threadpool::task::complete(bool cancelled)
+{
+	std::vector<std::shared_ptr<streamfx::util::threadpool::task>> continuations;
+
+	// Waiters check the flag while holding the lock, so changing it under the lock is enough to not lose the wake-up.
+	auto& spot = parking_spot_for(this);
+	{
+		std::unique_lock<std::mutex> lock(spot.lock);
+
+		// Only queued tasks can be cancelled, a running task completes once its callable has returned.
+		state expected = cancelled ? state::QUEUED : state::RUNNING;
+		if (!_state.compare_exchange_strong(expected, state::DONE, std::memory_order_acq_rel)) {
+			return;
+		}
+		_is_cancelled = cancelled;
+		continuations.swap(_continuations);
 	}
+	spot.cv.notify_all();
+
+	// Continuations only run if we did.
+	for (auto& task : continuations) {
+		if (cancelled || !_pool) {
+			task->complete(true);
+		} else {
+			_pool->enqueue(task);
+		}
+	}
+}
+
+void streamfx::util::threadpool::task::chain(std::shared_ptr<::streamfx::util::threadpool::task> task)
+{
+	{
+		std::unique_lock<std::mutex> lock(parking_spot_for(this).lock);
+		if (_state.load(std::memory_order_relaxed) != state::DONE) {
+			_continuations.emplace_back(task);
+			return;
+		}
+	}
+
+	// Already finished, so queue or cancel the continuation immediately.
+	if (_is_cancelled || !_pool) {
+		task->complete(true);
+	} else {
+		_pool->enqueue(task);
+	}
+}
+
+streamfx::util::threadpool::task_group::task_group() : _lock(), _tasks() {}
+
+streamfx::util::threadpool::task_group::~task_group() {}
+
+void streamfx::util::threadpool::task_group::add(std::shared_ptr<::streamfx::util::threadpool::task> task)
+{
+	if (!task) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(_lock);
+
+	// Forget about anything that has already finished.
+	_tasks.erase(std::remove_if(_tasks.begin(), _tasks.end(),
+								[](const std::shared_ptr<streamfx::util::threadpool::task>& v) {
+									return v->_state.load() == task::state::DONE;
+								}),
+				 _tasks.end());
+	_tasks.emplace_back(std::move(task));
+}
+
+void streamfx::util::threadpool::task_group::wait()
+{
+	std::vector<std::shared_ptr<streamfx::util::threadpool::task>> tasks;
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		tasks.swap(_tasks);
+	}
+
+	for (auto& task : tasks) {
+		task->await_completion();
+	}
+}
+
+void streamfx::util::threadpool::task_group::cancel()
+{
+	// Running tasks ignore this and stay in the group, so that wait() still waits for them.
+	std::unique_lock<std::mutex> lock(_lock);
+	for (auto& task : _tasks) {
+		task->complete(true);
+	}
+}
+
+bool streamfx::util::threadpool::task_group::empty()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	return std::all_of(_tasks.begin(), _tasks.end(), [](const std::shared_ptr<streamfx::util::threadpool::task>& v) {
+		return v->_state.load() == task::state::DONE;
+	});
 }
@@ -18,56 +18,269 @@
  */
 
 #pragma once
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace streamfx::util {
 	typedef std::shared_ptr<void>                  threadpool_data_t;
 	typedef std::function<void(threadpool_data_t)> threadpool_callback_t;
 
+	namespace threadpool_memory {
+		// Size of a single pooled block, large enough for a task and its shared_ptr control block.
+		static constexpr std::size_t block_size = 256;
+
+		void* allocate(std::size_t size);
+		void  deallocate(void* ptr, std::size_t size);
+
+		/** Allocator handing out fixed size blocks from a recycling pool.
+		 *
+		 * Requests larger than block_size fall back to the global allocator.
+		 */
+		template<typename T>
+		struct allocator {
+			typedef T value_type;
+
+			allocator() noexcept = default;
+			template<typename U>
+			allocator(const allocator<U>&) noexcept
+			{}
+
+			T* allocate(std::size_t n)
+			{
+				return static_cast<T*>(threadpool_memory::allocate(n * sizeof(T)));
+			}
+
+			void deallocate(T* ptr, std::size_t n) noexcept
+			{
+				threadpool_memory::deallocate(ptr, n * sizeof(T));
+			}
+
+			template<typename U>
+			bool operator==(const allocator<U>&) const noexcept
+			{
+				return true;
+			}
+
+			template<typename U>
+			bool operator!=(const allocator<U>&) const noexcept
+			{
+				return false;
+			}
+		};
+	} // namespace threadpool_memory
+
 	class threadpool {
 		public:
+		enum class priority : uint8_t {
+			// Work that must happen as soon as possible, like forwarding audio.
+			REALTIME = 0,
+			// Work that a user is waiting on.
+			INTERACTIVE = 1,
+			// Slow work like loading models or network requests.
+			BACKGROUND = 2,
+		};
+		static constexpr std::size_t priorities = 3;
+
+		typedef std::chrono::steady_clock::time_point deadline_t;
+
 		class task {
+			public:
+			// Callables up to this size are stored inside the task itself.
+			static constexpr std::size_t storage_size = 64;
+
 			protected:
-			std::mutex              _mutex;
-			std::condition_variable _is_complete;
-			std::atomic<bool>       _is_dead;
-			threadpool_callback_t   _callback;
-			threadpool_data_t       _data;
+			// Queued tasks can still be cancelled, running tasks can only be awaited.
+			enum class state : uint8_t {
+				QUEUED,
+				RUNNING,
+				DONE,
+			};
+
+			std::atomic<state> _state;
+			bool               _is_cancelled;
+			threadpool_data_t  _data;
+			priority           _priority;
+			deadline_t         _deadline;
+
+			// Pool the task was queued in, and tasks that are queued there once this one has run.
+			::streamfx::util::threadpool*                                    _pool;
+			std::vector<std::shared_ptr<::streamfx::util::threadpool::task>> _continuations;
+
+			alignas(std::max_align_t) unsigned char _storage[storage_size];
+			void* _callable;
+			void (*_invoke)(void*, threadpool_data_t&);
+			void (*_destroy)(void*);
 
 			public:
 			task();
-			task(threadpool_callback_t callback_function, threadpool_data_t data);
+			~task();
+
+			template<typename T>
+			task(T&& callback_function, threadpool_data_t data)
+				: _state(state::QUEUED), _is_cancelled(false), _data(std::move(data)), _priority(priority::INTERACTIVE),
+				  _deadline(deadline_t::max()), _pool(nullptr), _continuations(), _callable(nullptr), _invoke(nullptr),
+				  _destroy(nullptr)
+			{
+				typedef typename std::decay<T>::type callable_t;
+
+				if constexpr ((sizeof(callable_t) <= storage_size) && (alignof(callable_t) <= alignof(std::max_align_t))) {
+					_callable = new (_storage) callable_t(std::forward<T>(callback_function));
+					_destroy  = [](void* ptr) { static_cast<callable_t*>(ptr)->~callable_t(); };
+				} else {
+					_callable = new callable_t(std::forward<T>(callback_function));
+					_destroy  = [](void* ptr) { delete static_cast<callable_t*>(ptr); };
+				}
+				_invoke = [](void* ptr, threadpool_data_t& data) { (*static_cast<callable_t*>(ptr))(data); };
+			}
+
+			task(const task&) = delete;
+			task& operator=(const task&) = delete;
 
 			void await_completion();
 
+			/** Queue a callable to run after this task has run.
+			 *
+			 * The continuation receives the same data and runs at the same priority as this task. If this task is
+			 * cancelled or misses its deadline, the continuation is cancelled as well.
+			 */
+			template<typename T>
+			std::shared_ptr<::streamfx::util::threadpool::task> then(T&& callback_function)
+			{
+				auto task = std::allocate_shared<::streamfx::util::threadpool::task>(
+					threadpool_memory::allocator<::streamfx::util::threadpool::task>(),
+					std::forward<T>(callback_function), _data);
+				task->_priority = _priority;
+				task->_pool     = _pool;
+				chain(task);
+				return task;
+			}
+
+			protected:
+			bool start();
+
+			void complete(bool cancelled);
+
+			void chain(std::shared_ptr<::streamfx::util::threadpool::task> task);
+
 			friend class streamfx::util::threadpool;
 		};
 
+		/** Tracks a set of tasks so they can be awaited or cancelled together.
+		 */
+		class task_group {
+			std::mutex                                                       _lock;
+			std::vector<std::shared_ptr<::streamfx::util::threadpool::task>> _tasks;
+
+			public:
+			task_group();
+			~task_group();
+
+			void add(std::shared_ptr<::streamfx::util::threadpool::task> task);
+
+			/** Wait until every task in the group has either run or been cancelled.
+			 *
+			 * Tasks that are already running are waited for, so this must not be called while holding a lock that
+			 * any of the tasks takes.
+			 */
+			void wait();
+
+			/** Cancel every task in the group that has not yet started.
+			 */
+			void cancel();
+
+			bool empty();
+		};
+
 		private:
-		std::list<std::thread>                                         _workers;
-		std::atomic<bool>                                              _worker_stop;
-		std::atomic<uint32_t>                                          _worker_idx;
-		std::list<std::shared_ptr<::streamfx::util::threadpool::task>> _tasks;
-		std::mutex                                                     _tasks_lock;
-		std::condition_variable                                        _tasks_cv;
+		// Each worker owns a queue which it serves in order, idle workers steal from the back of other queues.
+		struct worker_queue {
+			std::mutex                                                      lock;
+			std::deque<std::shared_ptr<::streamfx::util::threadpool::task>> tasks;
+		};
+
+		// Every priority has its own set of workers, so slow background work can never occupy a real-time worker.
+		// Idle workers additionally help out lanes of a higher priority than their own.
+		struct lane {
+			std::vector<std::unique_ptr<worker_queue>> queues;
+			std::atomic<std::size_t>                   push_idx{0};
+			std::atomic<std::size_t>                   pending{0};
+			std::atomic<std::size_t>                   missed{0};
+			std::atomic<std::size_t>                   sleeping{0};
+			std::mutex                                 sleep_lock;
+			std::condition_variable                    sleep_cv;
+		};
+
+		std::array<lane, priorities> _lanes;
+		std::vector<std::thread>     _workers;
+		std::atomic<bool>            _worker_stop;
+		std::atomic<uint32_t>        _worker_idx;
 
 		public:
-		threadpool();
+		/** Create a new thread pool.
+		 *
+		 * @param concurrency Number of worker threads to spread across all priorities, 0 uses the number of hardware
+		 *                    threads. Every priority receives at least one worker.
+		 */
+		threadpool(std::size_t concurrency = 0);
 		~threadpool();
 
-		std::shared_ptr<::streamfx::util::threadpool::task> push(threadpool_callback_t callback_function,
-																 threadpool_data_t     data);
+		/** Queue a callable for execution.
+		 *
+		 * @param prio     Priority lane to queue the task in.
+		 * @param deadline Latest point in time at which the task is still worth starting. Tasks that are picked up
+		 *                 later are dropped and counted as missed.
+		 */
+		template<typename T>
+		std::shared_ptr<::streamfx::util::threadpool::task> push(T&& callback_function, threadpool_data_t data,
+																 priority   prio     = priority::INTERACTIVE,
+																 deadline_t deadline = deadline_t::max())
+		{
+			auto task = std::allocate_shared<::streamfx::util::threadpool::task>(
+				threadpool_memory::allocator<::streamfx::util::threadpool::task>(), std::forward<T>(callback_function),
+				std::move(data));
+			task->_priority = prio;
+			task->_deadline = deadline;
+			task->_pool     = this;
+			enqueue(task);
+			return task;
+		}
 
 		void pop(std::shared_ptr<::streamfx::util::threadpool::task> work);
 
+		/** Number of worker threads in this pool.
+		 */
+		std::size_t concurrency() const;
+
+		/** Number of tasks waiting to be picked up in the given lane.
+		 */
+		std::size_t queue_depth(priority prio) const;
+
+		/** Number of tasks in the given lane that were dropped due to a missed deadline.
+		 */
+		std::size_t missed_deadlines(priority prio) const;
+
 		private:
-		void work();
+		void enqueue(std::shared_ptr<::streamfx::util::threadpool::task> task);
+
+		std::shared_ptr<::streamfx::util::threadpool::task> acquire(std::size_t lane, std::size_t index);
+
+		bool has_work(std::size_t lane) const;
+
+		void wake(std::size_t lane);
+
+		void work(std::size_t lane, std::size_t index);
 	};
 } // namespace streamfx::util